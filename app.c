@@ -4,7 +4,7 @@
  * GUI and visualization using raylib to display data from app.c
  *      - Transforms reciprocal space points to pixel coordinates of application window 
  *      - Input validation/rollback of unallowed values for crystal system user choices 
- *      - Handles camera movement, limiting sphere for Cu Kalpha 1 radiation
+ *      - Handles camera movement, limiting sphere for the selected incoming radiation
  *      - Renders application and user interface
  * 
  ****************************************************************************************/
@@ -13,6 +13,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <stdbool.h>
 #define RAYGUI_IMPLEMENTATION
@@ -21,10 +22,16 @@
 // Crystal lattice dropdown options
 static const char *SYS_OPTIONS = "CUBIC;TETRAGONAL;HEXAGONAL;ORTHORHOMBIC;RHOMBOHEDRAL;MONOCLINIC;TRICLINIC";
 
+// Incoming radiation dropdown options and matching wavelengths (Angstrom)
+static const char *RAD_OPTIONS = "Cu Ka1;Mo Ka1;Ag Ka1;Co Ka1;Fe Ka1;Cr Ka1";
+static const char *RAD_NAMES[] = { "Cu Ka 1", "Mo Ka 1", "Ag Ka 1", "Co Ka 1", "Fe Ka 1", "Cr Ka 1" };
+static const double RAD_WAVELENGTHS[] = { CU_KA1, 0.709300, 0.559421, 1.788965, 1.936042, 2.289700 };
 
-// Plot points in reciprocal space on-screen
-bool plot_points(Crystal *crystal, AppState *s) {
-    if (!crystal->space || !crystal->space->pts || crystal->space->n == 0) { return false; }
+
+// Draw one reflection at reciprocal-space coordinates (u,v): a labelled dot for the zero-order zone,
+//  an unlabelled ring in the layer colour for higher-order Laue zones (extinct/off-screen points are skipped)
+void draw_reflection(AppState *s, RelpReal u, RelpReal v, RelpReal intensity, const RelpLabel *label, int order) {
+    if (intensity < 1e-6) { return; }
 
     int ox = GetScreenWidth() / 2;
     int oy = GetScreenHeight() / 2;
@@ -34,47 +41,75 @@ bool plot_points(Crystal *crystal, AppState *s) {
     int bar_width = s->guiScale * (screen_scale - 10);
     int bar_height = s->guiScale * (screen_scale - 18);
     double point_radius = s->guiScale * (screen_scale - 16);
+    const Color layer_colors[4] = { BLACK, BLUE, RED, DARKGREEN };   // ZOLZ, FOLZ, SOLZ, higher
 
-    for (size_t i = 0; i < crystal->space->n; i++) {
-        double sf = crystal->space->pts[i].intensity;
-        if (sf < 1e-6) { continue; }
+    int px = ox + (int)lround(u * (RelpReal)s->gridScale);
+    int py = oy + (int)lround(v * (RelpReal)s->gridScale);
 
-        double u = crystal->space->pts[i].u;
-        double v = crystal->space->pts[i].v;
-        
-        int px = ox + (int)lround(u * s->gridScale);
-        int py = oy + (int)lround(v * s->gridScale);
+    int x_start = px - s->guiScale * (screen_scale + 4);
+    int y_offset = py - s->guiScale * (screen_scale + 4);
 
-        int x_start = px - s->guiScale * (screen_scale + 4);
-        int y_offset = py - s->guiScale * (screen_scale + 4);
+    float halfW = (float)GetScreenWidth()  * 0.5f / s->camera.zoom;
+    float halfH = (float)GetScreenHeight() * 0.5f / s->camera.zoom;
 
-        float halfW = (float)GetScreenWidth()  * 0.5f / s->camera.zoom;
-        float halfH = (float)GetScreenHeight() * 0.5f / s->camera.zoom;
+    float left   = s->camera.target.x - halfW;
+    float right  = s->camera.target.x + halfW;
+    float top    = s->camera.target.y - halfH;
+    float bottom = s->camera.target.y + halfH;
 
-        float left   = s->camera.target.x - halfW;
-        float right  = s->camera.target.x + halfW;
-        float top    = s->camera.target.y - halfH;
-        float bottom = s->camera.target.y + halfH;
+    if (px < left || px > right || py < top || py > bottom) return;
 
-        if (px < left || px > right || py < top || py > bottom) continue;
+    // Higher-order Laue zone points are drawn as unlabelled rings around their projection
+    if (order != 0) {
+        DrawCircleLines(px, py, point_radius + s->guiScale * 3, layer_colors[abs(order) < 4 ? abs(order) : 3]);
+        return;
+    }
            
-        DrawCircle(px, py, point_radius, BLACK);
+    DrawCircle(px, py, point_radius, BLACK);
+
+    int hkl[3] = { label->h, label->k, label->l };
 
-        int *hkl_ptr = &crystal->space->pts[i].hkl.h;
+    for (int j = 0; j < 3; j++) {
+        int val = hkl[j];
+        int current_x = x_start + (j * text_spacing);
 
-        for (int j = 0; j < 3; j++) {
-            int val = *(hkl_ptr + j);
-            int current_x = x_start + (j * text_spacing);
+        if (val < 0) { DrawRectangle(current_x, y_offset - s->guiScale * 5, bar_width, bar_height, BLACK); }
+        DrawText(TextFormat("%d", abs(val)), current_x, y_offset, text_size, BLACK);
+    }  
+}
 
-            if (val < 0) { DrawRectangle(current_x, y_offset - s->guiScale * 5, bar_width, bar_height, BLACK); }
-            DrawText(TextFormat("%d", abs(val)), current_x, y_offset, text_size, BLACK);
-        }  
+
+// Plot points in reciprocal space on-screen
+bool plot_points(Crystal *crystal, AppState *s) {
+    const ReciprocalSpace *rs = crystal->space;
+    if (!rs || rs->n == 0) { return false; }
+
+    for (size_t L = 0; L < rs->n_layers; L++) {
+        const RSLayer *layer = &rs->layers[L];
+        if (abs(layer->order) > s->holz_val) { continue; }
+
+        for (size_t i = layer->offset; i < layer->offset + layer->n; i++) {
+            draw_reflection(s, rs->u[i], rs->v[i], rs->intensity[i], &rs->hkl[i], layer->order);
+        }
     }
     
     return true;
 }
 
 
+// Plot a zone read directly from the mapped catalog file
+bool plot_catalog(const CatalogReflection *refl, size_t n, AppState *s) {
+    if (!refl || n == 0) { return false; }
+
+    for (size_t i = 0; i < n; i++) {
+        RelpLabel label = { refl[i].h, refl[i].k, refl[i].l };
+        draw_reflection(s, refl[i].u, refl[i].v, refl[i].intensity, &label, 0);
+    }
+
+    return true;
+}
+
+
 // Get valid basis dropdown options for a given crystal system  
 int map_index(System type, int i) {
     if (i == 0) { return 0; }
@@ -277,6 +312,113 @@ void overdraw_parameters(int posX, int posY, double guiScale, int val) {
 }
 
 
+// Log the allocation counters of one of the crystal's arenas
+void log_arena(const Crystal *crystal, CrystalArena which) {
+    ArenaStats stats;
+    if (!crystal_arena_stats(crystal, which, &stats)) { return; }
+
+    TraceLog(LOG_DEBUG, "%s arena: %zu of %zu bytes in use (peak %zu), %zu allocations over %zu resets",
+             crystal_arena_name(which), stats.used, stats.reserved, stats.high_water, stats.allocations, stats.resets);
+}
+
+
+// Log which regeneration stages ran on the last update, and how long each took
+void log_pipeline(const Crystal *crystal) {
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        if (crystal->pipeline.ran & (1u << i)) {
+            double ms = crystal->pipeline.stage_ms[i];
+            TraceLog(LOG_DEBUG, "stage %-18s %8.3f ms", stage_name(i), ms);
+
+            // Structure-factor throughput against the engine's target, counting only reflections the direct sum evaluated
+            //  (none for closed forms, the FFT grid or a pass served by the memo)
+            if ((1u << i) == STAGE_SF && ms > 0 && crystal->cache->sf_summed > 0) {
+                double rate = (double)crystal->cache->sf_summed * (double)crystal->basis->n / (ms / 1000);
+                TraceLog(LOG_DEBUG, "structure factors (%s): %.3g reflections*atoms/s (target %.3g)",
+                         sf_engine_name(sf_engine_path()), rate, SF_TARGET_RATE);
+            }
+            if ((1u << i) == STAGE_PROJECTION) {
+                size_t hot = sizeof(*crystal->space->u) + sizeof(*crystal->space->v) + sizeof(*crystal->space->intensity);
+                TraceLog(LOG_DEBUG, "projection: %zu points, %zu bytes each (%zu read per frame)",
+                         crystal->space->n, hot + sizeof(*crystal->space->hkl), hot);
+                log_arena(crystal, CRYSTAL_ARENA_SPACE);
+            }
+            if ((1u << i) == STAGE_ATOMS) { log_arena(crystal, CRYSTAL_ARENA_BASIS); }
+            if ((1u << i) == STAGE_HKL) { log_arena(crystal, CRYSTAL_ARENA_TABLES); }
+            if ((1u << i) == STAGE_SF && crystal->memo->cap > 0) {
+                TraceLog(LOG_DEBUG, "structure-factor memo: %zu hits, %zu misses, %zu evictions",
+                         crystal->memo->hits, crystal->memo->misses, crystal->memo->evictions);
+                log_arena(crystal, CRYSTAL_ARENA_PARTS);
+            }
+        }
+    }
+}
+
+
+// Tilt the free viewing frame by a mouse drag: horizontal motion turns about the screen's vertical axis (e2),
+//  vertical motion about its horizontal axis (e1); re-orthonormalized so round-off cannot accumulate
+Mat3 tilt_frame(Mat3 frame, float dx, float dy) {
+    const double radians_per_pixel = 0.005;
+    Vec3 e1 = mat3_col(frame, 0);
+    Vec3 e2 = mat3_col(frame, 1);
+    Vec3 n = mat3_col(frame, 2);
+
+    double yaw = dx * radians_per_pixel;
+    e1 = v3_rotate(e1, e2, yaw);
+    n = v3_rotate(n, e2, yaw);
+
+    double pitch = -dy * radians_per_pixel;
+    e2 = v3_rotate(e2, e1, pitch);
+    n = v3_rotate(n, e1, pitch);
+
+    Mat3 out;
+    if (!gram_schmidt(v3_to_mat3(e1, e2, n), &out)) { return frame; }
+    return out;
+}
+
+
+// Open the zone-axis catalog for the current crystal and radiation, building it first if no matching file exists
+bool load_catalog(AppState *s) {
+    char path[64];
+    catalog_path(s->crystal, s->wavelength, CATALOG_DEFAULT_INDEX, path, sizeof(path));
+
+    catalog_close(s->catalog);
+    s->catalog = NULL;
+    s->cat_pts = NULL;
+
+    Catalog *cat = catalog_open(path);
+    if (!cat || !catalog_matches(cat, s->crystal, s->wavelength)) {
+        catalog_close(cat);
+        if (!catalog_build(s->crystal, s->wavelength, CATALOG_DEFAULT_INDEX, path)) { return false; }
+        cat = catalog_open(path);
+    }
+
+    s->catalog = cat;
+    return cat != NULL;
+}
+
+
+// Jump to the next best zone axis, searching first if there are no results for this crystal and ranking
+bool find_zone(AppState *s, SearchRank rank) {
+    if (zone_search_matches(&s->search, s->crystal, s->wavelength) && s->search.rank == rank) {
+        s->search_pos = (s->search_pos + 1) % s->search.n;
+    }
+    else {
+        if (!zone_search(s->crystal, s->wavelength, SEARCH_DEFAULT_INDEX, rank, SEARCH_DEFAULT_K, &s->search)) { return false; }
+        if (s->search.n == 0) { return false; }
+        s->search_pos = 0;
+        TraceLog(LOG_INFO, "Zone search: %zu scored, %zu pruned, %d threads", s->search.scanned, s->search.pruned, s->search.threads);
+    }
+
+    // The spinner check in app_draw picks up the new zone
+    HKL zone = s->search.top[s->search_pos].zone;
+    s->h_val = zone.h;
+    s->k_val = zone.k;
+    s->l_val = zone.l;
+
+    return true;
+}
+
+
 // Initialize the application state (UI, window, necessary structs)
 void app_init(AppState *s) { 
     // GUI/Window initialization
@@ -305,6 +447,21 @@ void app_init(AppState *s) {
     s->k_val = 0;
     s->l_val = 0;
 
+    // Zero-order Laue zone only
+    s->holz_val = 0;
+
+    // Point scatterers at rest without dispersion until an element is picked
+    s->anomalous = false;
+    s->biso_val = 0;
+
+    // Free view starts off, with a 0.10 1/A slab
+    s->free_view = false;
+    s->slab_val = 10;
+
+    // Incoming radiation (Cu K-alpha 1 by default)
+    s->radiationDropdown = 0;
+    s->wavelength = RAD_WAVELENGTHS[0];
+
     // Camera initialization
     s->camera.offset.x = screenWidth / 2;  
     s->camera.offset.y = screenHeight / 2;   
@@ -317,7 +474,7 @@ void app_init(AppState *s) {
     HKL zone = (HKL) {s->h_val, s->k_val, s->l_val};
 
     // Initial generation (and checks for failure), then snapshot of valid initial parameters as backup
-    if (!generate_space(s->crystal, CUBIC, PRIMITIVE, zone)) { TraceLog(LOG_INFO, "Space generation failed"); }
+    if (!generate_space(s->crystal, CUBIC, PRIMITIVE, zone, s->wavelength)) { TraceLog(LOG_INFO, "Space generation failed"); }
     if (!save_UI_state(&s->ui, s->crystal)) { TraceLog(LOG_INFO, "UI save failed"); }
 
     // Values to determine if zone axis has changed (and to rollback in case of user choosing 000)
@@ -346,16 +503,36 @@ void app_handle_input(AppState *s) {
 
     else { s->lastMouse = GetMousePosition(); }
 
+    // RIGHT DRAG TO TILT THE VIEWING DIRECTION (free view only)
+    if (s->free_view && IsMouseButtonDown(MOUSE_BUTTON_RIGHT)) {
+        Vector2 d = GetMouseDelta();
+        if (d.x != 0 || d.y != 0) {
+            s->view_frame = tilt_frame(s->view_frame, d.x, d.y);
+            s->needsSlab = true;
+        }
+    }
+
     // ZOOM IN/OUT
     float scroll = GetMouseWheelMove();
     if (scroll != 0) {
         float scale = 0.2f * scroll; 
         float zoom = expf(logf(s->camera.zoom)+scale);
-        if (zoom < 0.65) { zoom = 0.65; }
+        if (zoom < 0.25) { zoom = 0.25; }
         else if (zoom > 32.0) { zoom = 32.0; }
         s->camera.zoom = zoom;
     }
 
+    // BUILD/LOAD THE ZONE-AXIS CATALOG FOR THE CURRENT CRYSTAL
+    if (IsKeyPressed(KEY_C)) {
+        if (!load_catalog(s)) { TraceLog(LOG_INFO, "Catalog load failed"); }
+    }
+
+    // JUMP TO THE MOST POPULATED (F) OR STRONGEST (SHIFT+F) ZONE AXES
+    if (IsKeyPressed(KEY_F)) {
+        SearchRank rank = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT) ? SEARCH_BY_INTENSITY : SEARCH_BY_COUNT;
+        if (!find_zone(s, rank)) { TraceLog(LOG_INFO, "Zone search failed"); }
+    }
+
     if (IsKeyPressed(KEY_SPACE)) {
         s->camera.target.x = GetScreenWidth() / 2.0;
         s->camera.target.y = GetScreenHeight() / 2.0;
@@ -380,6 +557,29 @@ void app_handle_input(AppState *s) {
 
 // From GUI element values, determine valid inputs for lattice parameters (and rollback if invalid)
 void app_update(AppState *s) { 
+    // ZONE CHANGE: read straight from the catalog when it covers this crystal, radiation and zone
+    if (s->zoneChanged) {
+        if (s->h_val == 0 && s->k_val == 0 && s->l_val == 0) {
+            s->h_val = 1;
+            s->k_val = 0;
+            s->l_val = 0;
+        }
+
+        s->cat_pts = NULL;
+        if (!s->free_view && s->holz_val == 0 && catalog_matches(s->catalog, s->crystal, s->wavelength)) {
+            s->cat_pts = catalog_zone(s->catalog, (HKL) {s->h_val, s->k_val, s->l_val}, &s->cat_n);
+        }
+        if (!s->cat_pts) { s->needsUpdate = true; }
+
+        s->zoneChanged = false;
+    }
+
+    // Catalog zones hold no higher-order layers or 3D data; fall back to generating this zone
+    if (s->cat_pts && (s->holz_val > 0 || s->free_view)) {
+        s->cat_pts = NULL;
+        s->needsUpdate = true;
+    }
+
     // UPDATE POINTS
     if (s->needsUpdate) {
 
@@ -392,6 +592,9 @@ void app_update(AppState *s) {
 
         s->crystal->lattice.type = s->system_val;
         s->crystal->basis->type = s->basis_val;
+        s->crystal->basis->element = s->z_val;
+        s->crystal->basis->anomalous = s->anomalous;
+        s->crystal->basis->b_iso = (double)s->biso_val / 100;
 
         couple_fields(s->crystal->lattice.type, s->lastEdited, &s->a_val, &s->b_val, &s->c_val, &s->alpha_val, &s->beta_val, &s->gamma_val); 
 
@@ -407,24 +610,60 @@ void app_update(AppState *s) {
 
         else {
             update_crystal(s->crystal, (double)s->a_val / 100, (double)s->b_val / 100, (double)s->c_val / 100, s->alpha_val, s->beta_val, s->gamma_val);
-            if (!generate_space(s->crystal, s->crystal->lattice.type, s->crystal->basis->type, s->crystal->space->zone)) { 
+            if (!crystal_set_space_group(s->crystal, s->sg_val)) {
+                s->sg_val = 0;
+                s->prev_sg = 0;
+                crystal_set_space_group(s->crystal, 0);
+            }
+            if (!generate_space(s->crystal, s->crystal->lattice.type, s->crystal->basis->type, s->crystal->space->zone, s->wavelength)) { 
                 s->system_val = s->ui.lattice.type;
                 s->basis_val = s->ui.basis_type;
                 printf("%s\n", "Space generation failed"); 
                 return; 
             } 
+            log_pipeline(s->crystal);
             save_UI_state(&s->ui, s->crystal);
+            s->cat_pts = NULL;
+            if (s->free_view) { s->needsSlab = true; }
         }
 
         s->lastEdited = NONE;
         s->needsUpdate = false;
     }
+
+    // FREE VIEW: re-slice the cached reflections when the view normal or slab thickness changes
+    if (s->free_view) {
+        if (s->needsSlab) {
+            if (!generate_slab(s->crystal, s->view_frame, (double)s->slab_val / 100)) { TraceLog(LOG_INFO, "Slab generation failed"); }
+            s->needsSlab = false;
+        }
+        return;
+    }
+
+    // STREAM HIGHER-ORDER LAUE ZONES (one layer per frame, so the zero-order zone shows immediately)
+    ReciprocalSpace *rs = s->crystal->space;
+    size_t layers_wanted = 2 * (size_t)s->holz_val + 1;
+    if (rs->n_layers > layers_wanted) {
+        rs_keep_layers(rs, layers_wanted);
+    }
+    else if (rs->n_layers > 0 && rs->n_layers < layers_wanted) {
+        HKL fz = s->holz_failed_zone;
+        if (s->holz_failed && fz.h == rs->zone.h && fz.k == rs->zone.k && fz.l == rs->zone.l &&
+            s->holz_failed_wavelength == s->wavelength) { return; }
+
+        s->holz_failed = !generate_next_layer(s->crystal, s->wavelength);
+        if (s->holz_failed) {
+            s->holz_failed_zone = rs->zone;
+            s->holz_failed_wavelength = s->wavelength;
+            TraceLog(LOG_INFO, "Laue layer generation failed");
+        }
+    }
 }
 
 
 // Handle drawing of GUI elements, reciprocal space points, and limiting sphere
 void app_draw(AppState *s) {
-    float limiting_sphere_radius = s->gridScale * 2 * PI / 1.54;
+    float limiting_sphere_radius = s->gridScale * limiting_radius(s->wavelength);
     float ox = GetScreenWidth()  * 0.5f;
     float oy = GetScreenHeight() * 0.5f;
 
@@ -435,9 +674,10 @@ void app_draw(AppState *s) {
 
         // PLOTTING
         BeginMode2D(s->camera);
-        plot_points(s->crystal, s);
+        if (s->cat_pts) { plot_catalog(s->cat_pts, s->cat_n, s); }
+        else { plot_points(s->crystal, s); }
         DrawCircleLines((int)ox, (int)oy, limiting_sphere_radius, ORANGE);
-        DrawText("Limiting sphere (for Cu Ka 1)", limiting_sphere_radius, 0, s->guiScale * 20, ORANGE);
+        DrawText(TextFormat("Limiting sphere (for %s)", RAD_NAMES[s->radiationDropdown]), limiting_sphere_radius, 0, s->guiScale * 20, ORANGE);
         EndMode2D();
         
         // GUI ELEMENTS
@@ -457,6 +697,8 @@ void app_draw(AppState *s) {
                 s->basis_val = PRIMITIVE;
                 s->basisDropdown = 0; 
             } 
+            s->sg_val = 0;
+            s->prev_sg = 0;
             s->lastEdited = NONE;
             s->needsUpdate = true;
             s->systemActive = !s->systemActive;
@@ -466,6 +708,8 @@ void app_draw(AppState *s) {
             int i = map_index(s->system_val, s->basisDropdown);
             s->basis_val = i;
             if (i == -1) {s->basis_val = 0;}
+            s->sg_val = 0;
+            s->prev_sg = 0;
             s->needsUpdate = true;
             s->basisActive = !s->basisActive;
         }            
@@ -488,12 +732,94 @@ void app_draw(AppState *s) {
         if (GuiSpinner( (Rectangle){s->guiScale * 1190, 0, s->button_w, s->button_h}, "L: ", &s->l_val, -10, 10, s->l_edit)) { s->l_edit = !s->l_edit; }
         
         if (s->h_val != s->prev_h || s->k_val != s->prev_k || s->l_val != s->prev_l) {
-            s->needsUpdate = true;
+            s->zoneChanged = true;
             s->prev_h = s->h_val;
             s->prev_k = s->k_val;
             s->prev_l = s->l_val;
         }
         cover_parameters(s->system_val, s->guiScale, s->button_h);
+
+        // INCOMING RADIATION (bottom bar, dropdown rolls up)
+        int bottom_y = GetScreenHeight() - s->button_h;
+        DrawRectangle(0, bottom_y, GetScreenWidth(), s->button_h, LIGHTGRAY);
+        GuiSetStyle(DROPDOWNBOX, DROPDOWN_ROLL_UP, 1);
+        if (GuiDropdownBox( (Rectangle){s->guiScale * 0, bottom_y, (s->button_w + 40 * s->guiScale), s->button_h}, RAD_OPTIONS, &s->radiationDropdown, s->radiationActive)) {
+            s->wavelength = RAD_WAVELENGTHS[s->radiationDropdown];
+            s->needsUpdate = true;
+            s->radiationActive = !s->radiationActive;
+        }
+        GuiSetStyle(DROPDOWNBOX, DROPDOWN_ROLL_UP, 0);
+
+        // HIGHER-ORDER LAUE ZONES
+        if (GuiSpinner( (Rectangle){s->guiScale * 200, bottom_y, s->button_w, s->button_h}, "HOLZ: ", &s->holz_val, 0, 5, s->holz_edit)) { s->holz_edit = !s->holz_edit; }
+
+        // FREE VIEW (right drag tilts the view normal, slab thickness in 1/A)
+        bool free_view = s->free_view;
+        GuiToggle( (Rectangle){s->guiScale * 300, bottom_y, (s->button_w + 40 * s->guiScale), s->button_h}, "Free view", &free_view);
+        if (free_view != s->free_view) {
+            s->free_view = free_view;
+            if (free_view) {
+                s->view_frame = zone_frame(&s->crystal->lattice, (HKL) {s->h_val, s->k_val, s->l_val});
+                s->needsSlab = true;
+            }
+            else { s->needsUpdate = true; }
+        }
+        if (GuiValueBox( (Rectangle){s->guiScale * 480, bottom_y, (s->button_w - 40 * s->guiScale), s->button_h}, "Slab ", &s->slab_val, 1, 999, s->slab_edit)) { s->needsSlab = true; s->slab_edit = !s->slab_edit; }
+        overdraw_parameters(483, bottom_y / s->guiScale + 2, s->guiScale, s->slab_val);
+
+        // CATALOG STATUS
+        bool catalog_ready = catalog_matches(s->catalog, s->crystal, s->wavelength);
+        DrawText(catalog_ready ? "Catalog: loaded" : "Catalog: press C", s->guiScale * 580, bottom_y + s->guiScale * 6, s->guiScale * 20, DARKGRAY);
+
+        // SPACE GROUP (once editing ends, steps past groups that do not fit the system and basis)
+        if (GuiSpinner( (Rectangle){s->guiScale * 820, bottom_y, s->button_w, s->button_h}, "SG: ", &s->sg_val, 0, SG_COUNT, s->sg_edit)) { s->sg_edit = !s->sg_edit; }
+        if (!s->sg_edit && s->sg_val != s->prev_sg) {
+            int step = s->sg_val > s->prev_sg ? 1 : -1;
+            while (s->sg_val > 0 && s->sg_val <= SG_COUNT && !space_group_valid(s->system_val, s->basis_val, s->sg_val)) { s->sg_val += step; }
+            if (s->sg_val > SG_COUNT) { s->sg_val = s->prev_sg; }
+            s->prev_sg = s->sg_val;
+            s->needsUpdate = true;
+        }
+        DrawText(sg_symbol(s->sg_val), s->guiScale * 910, bottom_y + s->guiScale * 6, s->guiScale * 20, DARKGRAY);
+
+        // SCATTERING (strip above the bottom bar, right of the radiation dropdown's roll-up)
+        int scatter_y = bottom_y - s->button_h;
+        DrawRectangle(s->guiScale * 770, scatter_y, GetScreenWidth() - s->guiScale * 770, s->button_h, LIGHTGRAY);
+
+        // ELEMENT (atomic form factors; 0 keeps unit point scatterers)
+        if (GuiSpinner( (Rectangle){s->guiScale * 820, scatter_y, s->button_w, s->button_h}, "Z: ", &s->z_val, 0, FF_MAX_Z, s->z_edit)) { s->z_edit = !s->z_edit; }
+        if (!s->z_edit && s->z_val != s->prev_z) {
+            int step = s->z_val > s->prev_z ? 1 : -1;
+            while (s->z_val > 0 && s->z_val <= FF_MAX_Z && !ff_known(s->z_val)) { s->z_val += step; }
+            if (s->z_val > FF_MAX_Z) { s->z_val = s->prev_z; }
+            s->prev_z = s->z_val;
+            s->needsUpdate = true;
+        }
+        DrawText(s->z_val ? ff_symbol(s->z_val) : "point", s->guiScale * 910, scatter_y + s->guiScale * 6, s->guiScale * 20, DARKGRAY);
+
+        // ANOMALOUS DISPERSION (f' + i f'' of the element at the selected radiation)
+        bool anomalous = s->anomalous;
+        GuiToggle( (Rectangle){s->guiScale * 970, scatter_y, (s->button_w + 40 * s->guiScale), s->button_h}, "Anomalous", &anomalous);
+        if (anomalous != s->anomalous) {
+            s->anomalous = anomalous;
+            s->needsUpdate = true;
+        }
+
+        // THERMAL MOTION (Debye-Waller factor exp(-Biso s^2) of every basis atom, Biso in A^2)
+        if (GuiValueBox( (Rectangle){s->guiScale * 1150, scatter_y, (s->button_w - 40 * s->guiScale), s->button_h}, "Biso ", &s->biso_val, 0, 999, s->biso_edit)) { s->needsUpdate = true; s->biso_edit = !s->biso_edit; }
+        overdraw_parameters(1153, scatter_y / s->guiScale + 2, s->guiScale, s->biso_val);
+
+        // ZONE SEARCH RESULTS (current one highlighted)
+        if (zone_search_matches(&s->search, s->crystal, s->wavelength)) {
+            int line_h = s->guiScale * 22;
+            int y = s->button_h + s->guiScale * 8;
+            DrawText(s->search.rank == SEARCH_BY_COUNT ? "Top zones (count)" : "Top zones (sum |F|^2)", s->guiScale * 8, y, s->guiScale * 20, DARKGRAY);
+            for (size_t i = 0; i < s->search.n; i++) {
+                const ZoneScore *z = &s->search.top[i];
+                DrawText(TextFormat("[%d %d %d]  %d  %.0f", z->zone.h, z->zone.k, z->zone.l, z->count, z->intensity),
+                         s->guiScale * 8, y + (int)(i + 1) * line_h, s->guiScale * 20, i == s->search_pos ? RED : DARKGRAY);
+            }
+        }
         
     EndDrawing();
 }
@@ -501,13 +827,16 @@ void app_draw(AppState *s) {
 
 // Free allocated memory in structs + close application window
 void app_shutdown(AppState *s) { 
+    catalog_close(s->catalog);
     crystal_free(s->crystal);
     CloseWindow();       
 }
 
 
-// Main function
-int main(void) {
+// Main function (--search runs the zone-axis search headless and prints the results)
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--search") == 0) { return zone_search_cli(argc, argv); }
+
     AppState s = {0};
     app_init(&s);
     
@@ -4,6 +4,9 @@
 #include <stdbool.h>   
 #include <raylib.h>
 #include "crystal.h"
+#include "catalog.h"
+#include "search.h"
+#include "sf_engine.h"
 
 
 // Enum to record the most recent ValueBox edited (to compute which needs a rollback)
@@ -33,12 +36,18 @@ typedef struct {
     Vector2 lastMouse;
     float zoom;
 
-    int systemDropdown, basisDropdown;
-    bool systemActive, basisActive;
+    int systemDropdown, basisDropdown, radiationDropdown;
+    bool systemActive, basisActive, radiationActive;
+    double wavelength;
     System system_val;
     BasisType basis_val;
 
     int h_val, k_val, l_val;
+    int holz_val;   // highest Laue layer order shown (0 = zero-order zone only)
+    bool holz_edit;
+    bool holz_failed;               // a Laue layer failed: none are tried again until the zone or radiation changes
+    HKL holz_failed_zone;
+    double holz_failed_wavelength;
     int a_val, b_val, c_val; 
     int alpha_val, beta_val, gamma_val;
     bool h_edit; bool k_edit; bool l_edit;
@@ -48,15 +57,49 @@ typedef struct {
 
     int prev_h, prev_k, prev_l;
 
+    // Space group whose systematic absences are removed (0 = none); the spinner skips groups that do not fit
+    int sg_val, prev_sg;
+    bool sg_edit;
+
+    // Element of the basis atoms (0 = unit point scatterers); the spinner skips elements without form factors
+    int z_val, prev_z;
+    bool z_edit;
+    bool anomalous; // add the element's f' + i f'' at the selected radiation
+    int biso_val;   // isotropic displacement parameter Biso of the basis atoms in 1/100 A^2
+    bool biso_edit;
+
+    // Free viewing direction: a slab through the cached 3D reflections instead of a rational zone
+    bool free_view;
+    bool needsSlab;
+    Mat3 view_frame;    // columns e1, e2 span the screen, column 2 is the view normal
+    int slab_val;       // slab thickness in 1/100 inverse Angstrom
+    bool slab_edit;
+
+    // Zone-axis catalog: zone changes are served from the mapped file while it matches the crystal
+    Catalog *catalog;
+    const CatalogReflection *cat_pts;   // zone shown straight from the catalog, NULL when generated
+    size_t cat_n;
+    bool zoneChanged;
+
+    // Zone-axis search results (F cycles through them)
+    ZoneSearch search;
+    size_t search_pos;
+
     // Simulation state
     Crystal *crystal;
     UIState ui;
 } AppState;
 
 
+void draw_reflection(AppState *s, RelpReal u, RelpReal v, RelpReal intensity, const RelpLabel *label, int order);
+
+
 bool plot_points(Crystal *crystal, AppState *s);
 
 
+bool plot_catalog(const CatalogReflection *refl, size_t n, AppState *s);
+
+
 const char *options(System type);
 
 
@@ -78,6 +121,21 @@ bool update_crystal(Crystal *crystal, double a, double b, double c, double alpha
 bool basis_allowed(System type, BasisType bas);
 
 
+void log_arena(const Crystal *crystal, CrystalArena which);
+
+
+void log_pipeline(const Crystal *crystal);
+
+
+Mat3 tilt_frame(Mat3 frame, float dx, float dy);
+
+
+bool load_catalog(AppState *s);
+
+
+bool find_zone(AppState *s, SearchRank rank);
+
+
 void cover_parameters(System type, double guiScale, int button_height);
 
 
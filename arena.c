@@ -0,0 +1,131 @@
+/****************************************************************************************
+ * arena.c
+ *
+ * Arena allocation for the parts of a crystal that are created and dropped together
+ *  - An allocation bumps an offset in the current block; when it does not fit, the next
+ *    block of the chain is taken, or a new one of max(block size, request) appended
+ *  - A reset only rewinds to the first block (each block is rewound as it is reached
+ *    again), so it is O(1) and the next round reuses the same memory without the heap
+ *  - Freeing releases every block in one pass; nothing is freed on its own
+ *
+ ****************************************************************************************/
+
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+// STRUCTS ------------------------ //
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;    // usable bytes after the header
+    size_t used;
+};
+
+#define ARENA_HEADER ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+
+// METHODS ------------------------ //
+
+static ArenaBlock *arena_block_new(size_t size) {
+    size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+#if defined(_WIN32)
+    ArenaBlock *block = _aligned_malloc(ARENA_HEADER + size, ARENA_ALIGN);
+#else
+    ArenaBlock *block = aligned_alloc(ARENA_ALIGN, ARENA_HEADER + size);
+#endif
+    if (!block) { return NULL; }
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+
+static void arena_block_free(ArenaBlock *block) {
+#if defined(_WIN32)
+    _aligned_free(block);
+#else
+    free(block);
+#endif
+}
+
+
+// ARENA_ALIGN-aligned, uninitialized memory that lives until the next reset; NULL if the heap runs out
+void *arena_alloc(Arena *arena, size_t bytes) {
+    if (!arena) { return NULL; }
+
+    bytes = arena_round(bytes);
+
+    ArenaBlock *block = arena->current;
+    while (!block || block->used + bytes > block->size) {
+        if (block && block->next) {
+            block = block->next;
+            block->used = 0;
+            continue;
+        }
+
+        size_t size = arena->block_size ? arena->block_size : ARENA_BLOCK;
+        ArenaBlock *grown = arena_block_new(bytes > size ? bytes : size);
+        if (!grown) { return NULL; }
+
+        if (block) { block->next = grown; }
+        else { arena->first = grown; }
+        arena->reserved += grown->size;
+        block = grown;
+    }
+    arena->current = block;
+
+    void *p = (char *)block + ARENA_HEADER + block->used;
+    block->used += bytes;
+
+    arena->allocations++;
+    arena->used += bytes;
+    if (arena->used > arena->high_water) { arena->high_water = arena->used; }
+
+    return p;
+}
+
+
+// As arena_alloc for n zeroed items of size bytes
+void *arena_calloc(Arena *arena, size_t n, size_t size) {
+    if (size && n > (size_t)-1 / size) { return NULL; }
+
+    void *p = arena_alloc(arena, n * size);
+    if (p) { memset(p, 0, n * size); }
+    return p;
+}
+
+
+// Give back everything allocated so far (the blocks are kept for reuse)
+void arena_reset(Arena *arena) {
+    if (!arena) { return; }
+
+    arena->current = arena->first;
+    if (arena->current) { arena->current->used = 0; }
+    arena->used = 0;
+    arena->resets++;
+
+    return;
+}
+
+
+// Release every block; the arena is empty afterwards, its counters are kept
+void arena_free(Arena *arena) {
+    if (!arena) { return; }
+
+    for (ArenaBlock *block = arena->first, *next; block; block = next) {
+        next = block->next;
+        arena_block_free(block);
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->used = 0;
+    arena->reserved = 0;
+
+    return;
+}
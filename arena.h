@@ -0,0 +1,59 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define ARENA_ALIGN 64              // bytes; every allocation starts on a cache line
+#define ARENA_BLOCK (64 * 1024)     // default block size; larger requests get a block of their own
+
+
+// STRUCTS ------------------------ //
+
+typedef struct ArenaBlock ArenaBlock;
+
+
+// Bump allocator over a chain of blocks that are kept across resets (a zeroed Arena is empty and usable)
+typedef struct {
+    ArenaBlock *first;
+    ArenaBlock *current;    // block allocations come from; the ones after it are free again since the last reset
+    size_t block_size;      // 0 = ARENA_BLOCK
+
+    size_t allocations;     // since the arena was created
+    size_t resets;
+    size_t used;            // bytes handed out since the last reset, alignment included
+    size_t high_water;      // most bytes ever in use between two resets
+    size_t reserved;        // bytes held in blocks
+} Arena;
+
+
+// The counters of an Arena, for reporting outside the code that owns it
+typedef struct {
+    size_t allocations;
+    size_t resets;
+    size_t used;
+    size_t high_water;
+    size_t reserved;
+} ArenaStats;
+
+
+// Bytes an allocation of the given size takes from its block
+static inline size_t arena_round(size_t bytes) {
+    return bytes ? (bytes + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN : ARENA_ALIGN;
+}
+
+
+
+void *arena_alloc(Arena *arena, size_t bytes);
+
+
+void *arena_calloc(Arena *arena, size_t n, size_t size);
+
+
+void arena_reset(Arena *arena);
+
+
+void arena_free(Arena *arena);
+
+
+#endif
@@ -0,0 +1,280 @@
+/****************************************************************************************
+ * catalog.c
+ *
+ * Precomputed zone-axis catalog stored as one contiguous binary file
+ *  - Enumerates every primitive zone [uvw] up to a maximum index for a crystal
+ *  - Stores each zone's in-plane reflections (hkl, u, v, |F|^2) as an offset-indexed block
+ *  - Files are memory-mapped read-only, so switching zones needs no computation or copies
+ *  - Catalogs are keyed by lattice parameters, basis type and wavelength
+ *
+ ****************************************************************************************/
+
+
+#include "catalog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+    #define CATALOG_NO_MMAP
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+
+// Fill the key fields of a header from a crystal
+static void catalog_key(CatalogHeader *hdr, const Crystal *crystal, double wavelength) {
+    hdr->a = crystal->lattice.a;
+    hdr->b = crystal->lattice.b;
+    hdr->c = crystal->lattice.c;
+    hdr->alpha = crystal->lattice.alpha;
+    hdr->beta = crystal->lattice.beta;
+    hdr->gamma = crystal->lattice.gamma;
+    hdr->system = (int32_t)crystal->lattice.type;
+    hdr->basis_type = (int32_t)crystal->basis->type;
+    hdr->element = (int32_t)crystal->basis->element;
+    hdr->anomalous = (int32_t)crystal->basis->anomalous;
+    hdr->space_group = (int32_t)crystal->group->number;
+    hdr->b_iso = crystal->basis->b_iso;
+    hdr->wavelength = wavelength;
+}
+
+
+// File name derived from a hash (FNV-1a) of the key, so a catalog is found again for the same crystal
+void catalog_path(const Crystal *crystal, double wavelength, int max_index, char *buf, size_t len) {
+    CatalogHeader key;
+    memset(&key, 0, sizeof(key));   // padding bytes are hashed too
+    catalog_key(&key, crystal, wavelength);
+    key.max_index = max_index;
+
+    const unsigned char *bytes = (const unsigned char *)&key;
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < sizeof(key); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    snprintf(buf, len, "rlv_%016llx.cat", (unsigned long long)hash);
+}
+
+
+// Enumerate the catalog zones: primitive [uvw] with |u|,|v|,|w| <= max_index, sorted by (u,v,w)
+static size_t catalog_zones(int max_index, CatalogZone *zones) {
+    size_t count = 0;
+    for (int u = -max_index; u <= max_index; u++) {
+        for (int v = -max_index; v <= max_index; v++) {
+            for (int w = -max_index; w <= max_index; w++) {
+                if (int_gcd(int_gcd(u, v), w) != 1) { continue; }
+                if (zones) {
+                    zones[count] = (CatalogZone){ .u = (int16_t)u, .v = (int16_t)v, .w = (int16_t)w };
+                }
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+
+// Consumer writing a zone's streamed reflections straight to the catalog file
+typedef struct {
+    FILE *f;
+    uint64_t n;     // records written for the current zone
+} CatalogWriter;
+
+
+static bool catalog_write(void *user, const ReciprocalPoint *pts, size_t n) {
+    CatalogWriter *w = user;
+    CatalogReflection rec[RELP_CHUNK];
+
+    for (size_t i = 0; i < n; i++) {
+        rec[i] = (CatalogReflection){
+            .h = (int16_t)pts[i].hkl.h,
+            .k = (int16_t)pts[i].hkl.k,
+            .l = (int16_t)pts[i].hkl.l,
+            .u = (float)pts[i].u,
+            .v = (float)pts[i].v,
+            .intensity = (float)pts[i].intensity
+        };
+    }
+
+    w->n += n;
+    return fwrite(rec, sizeof(*rec), n, w->f) == n;
+}
+
+
+// Build a catalog file for the crystal's current lattice and basis
+//  Each zone is streamed from the crystal's reflection cache straight into the file, so memory use does
+//  not grow with the catalog and the crystal's own projected zone is left as it was
+bool catalog_build(Crystal *crystal, double wavelength, int max_index, const char *path) {
+    if (!crystal || !crystal->space || !path || max_index < 1 || max_index > INT16_MAX) { return false; }
+
+    // Bring the reflection cache up to date for this radiation
+    HKL current = crystal->space->zone;
+    if (current.h == 0 && current.k == 0 && current.l == 0) { current = (HKL){0, 0, 1}; }
+    if (!crystal_update(crystal, current, wavelength)) { return false; }
+
+    size_t n_zones = catalog_zones(max_index, NULL);
+    CatalogZone *zones = calloc(n_zones, sizeof(*zones));
+    if (!zones) { return false; }
+    catalog_zones(max_index, zones);
+
+    FILE *f = fopen(path, "wb");
+    if (!f) { free(zones); return false; }
+
+    CatalogHeader hdr = {0};
+    memcpy(hdr.magic, CATALOG_MAGIC, sizeof(hdr.magic));
+    hdr.version = CATALOG_VERSION;
+    hdr.max_index = max_index;
+    catalog_key(&hdr, crystal, wavelength);
+    hdr.n_zones = n_zones;
+    hdr.zones_offset = sizeof(hdr);
+    hdr.refl_offset = hdr.zones_offset + n_zones * sizeof(*zones);
+
+    // Reflection records go after the (rewritten at the end) header and zone table
+    bool ok = fseek(f, (long)hdr.refl_offset, SEEK_SET) == 0;
+
+    uint64_t n_refl = 0;
+    for (size_t z = 0; ok && z < n_zones; z++) {
+        HKL zone = (HKL){ zones[z].u, zones[z].v, zones[z].w };
+
+        CatalogWriter w = { .f = f, .n = 0 };
+        if (!stream_relp(crystal, zone, wavelength, catalog_write, &w)) { ok = false; break; }
+
+        if (n_refl + w.n > UINT32_MAX) { ok = false; break; }
+        zones[z].offset = (uint32_t)n_refl;
+        zones[z].n = (uint32_t)w.n;
+        n_refl += w.n;
+    }
+
+    hdr.n_refl = n_refl;
+    ok = ok && fseek(f, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    ok = ok && fwrite(zones, sizeof(*zones), n_zones, f) == n_zones;
+    ok = (fclose(f) == 0) && ok;
+
+    free(zones);
+
+    if (!ok) { remove(path); }
+    return ok;
+}
+
+
+// Map a catalog file read-only and validate its layout
+Catalog* catalog_open(const char *path) {
+    if (!path) { return NULL; }
+
+    Catalog *cat = calloc(1, sizeof(*cat));
+    if (!cat) { return NULL; }
+
+#if defined(CATALOG_NO_MMAP)
+    // No mmap: read the whole file once instead
+    FILE *f = fopen(path, "rb");
+    if (!f) { free(cat); return NULL; }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size <= 0) { fclose(f); free(cat); return NULL; }
+    cat->map = malloc((size_t)size);
+    if (!cat->map || fread(cat->map, 1, (size_t)size, f) != (size_t)size) {
+        fclose(f);
+        free(cat->map);
+        free(cat);
+        return NULL;
+    }
+    fclose(f);
+    cat->size = (size_t)size;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { free(cat); return NULL; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) { close(fd); free(cat); return NULL; }
+    cat->size = (size_t)st.st_size;
+    cat->map = mmap(NULL, cat->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (cat->map == MAP_FAILED) { free(cat); return NULL; }
+#endif
+
+    const CatalogHeader *hdr = cat->map;
+    bool valid = cat->size >= sizeof(*hdr) &&
+                 memcmp(hdr->magic, CATALOG_MAGIC, sizeof(hdr->magic)) == 0 &&
+                 hdr->version == CATALOG_VERSION &&
+                 hdr->zones_offset + hdr->n_zones * sizeof(CatalogZone) <= cat->size &&
+                 hdr->refl_offset + hdr->n_refl * sizeof(CatalogReflection) <= cat->size;
+    if (!valid) { catalog_close(cat); return NULL; }
+
+    cat->header = hdr;
+    cat->zones = (const CatalogZone *)((const char *)cat->map + hdr->zones_offset);
+    cat->refl = (const CatalogReflection *)((const char *)cat->map + hdr->refl_offset);
+
+    return cat;
+}
+
+
+void catalog_close(Catalog *cat) {
+    if (!cat) { return; }
+
+#if defined(CATALOG_NO_MMAP)
+    free(cat->map);
+#else
+    if (cat->map) { munmap(cat->map, cat->size); }
+#endif
+    free(cat);
+
+    return;
+}
+
+
+// Was the catalog built for this crystal's lattice parameters, basis, element, dispersion, Biso, space group and radiation?
+bool catalog_matches(const Catalog *cat, const Crystal *crystal, double wavelength) {
+    if (!cat || !crystal) { return false; }
+
+    CatalogHeader key = {0};
+    catalog_key(&key, crystal, wavelength);
+
+    const CatalogHeader *hdr = cat->header;
+    return hdr->a == key.a && hdr->b == key.b && hdr->c == key.c &&
+           hdr->alpha == key.alpha && hdr->beta == key.beta && hdr->gamma == key.gamma &&
+           hdr->system == key.system && hdr->basis_type == key.basis_type &&
+           hdr->element == key.element && hdr->anomalous == key.anomalous && hdr->space_group == key.space_group &&
+           hdr->b_iso == key.b_iso &&
+           hdr->wavelength == key.wavelength;
+}
+
+
+static int zone_cmp(int u1, int v1, int w1, const CatalogZone *z) {
+    if (u1 != z->u) { return u1 < z->u ? -1 : 1; }
+    if (v1 != z->v) { return v1 < z->v ? -1 : 1; }
+    if (w1 != z->w) { return w1 < z->w ? -1 : 1; }
+    return 0;
+}
+
+
+// Reflections of a zone, pointing straight into the mapped file (NULL if the zone is not catalogued)
+const CatalogReflection *catalog_zone(const Catalog *cat, HKL zone, size_t *n) {
+    if (!cat || !n) { return NULL; }
+
+    HKL z = hkl_primitive(zone);
+
+    // Binary search of the sorted zone table
+    size_t lo = 0, hi = cat->header->n_zones;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = zone_cmp(z.h, z.k, z.l, &cat->zones[mid]);
+        if (c == 0) {
+            const CatalogZone *entry = &cat->zones[mid];
+            if ((uint64_t)entry->offset + entry->n > cat->header->n_refl) { break; }
+            *n = entry->n;
+            return cat->refl + entry->offset;
+        }
+        if (c < 0) { hi = mid; }
+        else { lo = mid + 1; }
+    }
+
+    *n = 0;
+    return NULL;
+}
@@ -0,0 +1,82 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "crystal.h"
+
+#define CATALOG_MAGIC "RLVCAT01"
+#define CATALOG_VERSION 5
+#define CATALOG_DEFAULT_INDEX 5   // zones [uvw] with |u|,|v|,|w| <= 5
+
+
+// STRUCTS ------------------------ //
+// On-disk layout (native endianness): header, zone table sorted by (u,v,w), reflection records
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    int32_t max_index;
+
+    // Key: the catalog only describes crystals with these parameters
+    double a, b, c;
+    double alpha, beta, gamma;
+    int32_t system;
+    int32_t basis_type;
+    int32_t element;
+    int32_t anomalous;
+    int32_t space_group;
+    double b_iso;
+    double wavelength;
+
+    uint64_t n_zones;
+    uint64_t zones_offset;  // byte offset of the zone table
+    uint64_t n_refl;
+    uint64_t refl_offset;   // byte offset of the reflection records
+} CatalogHeader;
+
+
+typedef struct {
+    int16_t u, v, w, pad;
+    uint32_t offset;    // first reflection record of the zone
+    uint32_t n;
+} CatalogZone;
+
+
+typedef struct {
+    int16_t h, k, l, pad;
+    float u, v;
+    float intensity;    // |F|^2
+} CatalogReflection;
+
+
+typedef struct {
+    void *map;
+    size_t size;
+    const CatalogHeader *header;
+    const CatalogZone *zones;
+    const CatalogReflection *refl;
+} Catalog;
+
+
+
+void catalog_path(const Crystal *crystal, double wavelength, int max_index, char *buf, size_t len);
+
+
+bool catalog_build(Crystal *crystal, double wavelength, int max_index, const char *path);
+
+
+Catalog* catalog_open(const char *path);
+
+
+void catalog_close(Catalog *cat);
+
+
+bool catalog_matches(const Catalog *cat, const Crystal *crystal, double wavelength);
+
+
+const CatalogReflection *catalog_zone(const Catalog *cat, HKL zone, size_t *n);
+
+
+#endif
@@ -5,107 +5,287 @@
  *  - Uses lattice vectors to calculate reciprocal vector basis
  *  - From plane normal and reciprocal vectors, gets "2D plane" array of lattice points
  *  - Uses structure factor to calculate viewable reciprocal points
+ *  - Space-group systematic absences are dropped before any structure factor is computed
  * 
+ *      - Regeneration pipeline re-runs only the stages whose inputs changed
  *      - Contains struct-related methods to resize/destroy dynamically allocated arrays
  *
  ****************************************************************************************/
 
 
 #include "crystal.h"
+#include "sf_engine.h"
+#include "sf_grid.h"
+#include "laue.h"
+#include "sf_memo.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <complex.h>
+#include <time.h>
 
 
+// Release what the basis owns (the struct itself belongs to its crystal's arena)
 void basis_atoms_destroy(BasisAtoms *bas) {
     if (!bas) { return; }
 
-    free(bas->pos);
-    free(bas->Z);
-    free(bas);
+    arena_free(&bas->arena);
+    sf_atoms_free(&bas->soa);
+    ff_free(&bas->ff);
 
     return;
 }
 
 
+// Every resize replaces all four arrays, so the old ones are dropped by rewinding the basis arena;
+//  if memory runs out the basis is left empty
 bool basis_atoms_resize(size_t n, BasisAtoms *bas) {
     if (!bas) { return false; }
 
     if (bas->n == n) { return true; }
 
-    if (n == 0) {
-        free(bas->pos);
-        free(bas->Z);
-        bas->pos = NULL;
-        bas->Z = NULL;
-        bas->n = 0;
-        return true; 
-    }
+    arena_reset(&bas->arena);
+    bas->pos = NULL;
+    bas->Z = NULL;
+    bas->Biso = NULL;
+    bas->U = NULL;
+    bas->n = 0;
 
-    Vec3 *new_pos = malloc(n * sizeof(*new_pos));
-    int *new_Z = malloc(n * sizeof(*new_Z));
+    if (n == 0) { return true; }
 
-    if (!new_pos || !new_Z) {
-        free(new_pos);
-        free(new_Z);
-        return false;
-    }
+    // New atoms start as unit point scatterers at rest
+    Vec3 *new_pos = arena_alloc(&bas->arena, n * sizeof(*new_pos));
+    int *new_Z = arena_calloc(&bas->arena, n, sizeof(*new_Z));
+    double *new_Biso = arena_calloc(&bas->arena, n, sizeof(*new_Biso));
+    Mat3 *new_U = arena_calloc(&bas->arena, n, sizeof(*new_U));
+    if (!new_pos || !new_Z || !new_Biso || !new_U) { return false; }
 
-    free(bas->pos);
-    free(bas->Z);
     bas->pos = new_pos;
     bas->Z = new_Z;
+    bas->Biso = new_Biso;
+    bas->U = new_U;
     bas->n = n;
 
     return true;
 }
 
 
+// Release what the space owns (the struct itself belongs to its crystal's arena)
 void rs_destroy(ReciprocalSpace *rs) {
     if (!rs) { return; }
 
-    free(rs->pts);
-    free(rs);
+    arena_free(&rs->arena);
 
     return;
 }
 
 
+// Carve point arrays for cap points from the space arena, carrying over the current ones
+static bool rs_carve_points(ReciprocalSpace *rs, size_t cap) {
+    RelpReal *new_u = arena_alloc(&rs->arena, cap * sizeof(*new_u));
+    RelpReal *new_v = arena_alloc(&rs->arena, cap * sizeof(*new_v));
+    RelpReal *new_intensity = arena_alloc(&rs->arena, cap * sizeof(*new_intensity));
+    RelpLabel *new_hkl = arena_alloc(&rs->arena, cap * sizeof(*new_hkl));
+    if (!new_u || !new_v || !new_intensity || !new_hkl) { return false; }
+
+    if (rs->n) {
+        memcpy(new_u, rs->u, rs->n * sizeof(*new_u));
+        memcpy(new_v, rs->v, rs->n * sizeof(*new_v));
+        memcpy(new_intensity, rs->intensity, rs->n * sizeof(*new_intensity));
+        memcpy(new_hkl, rs->hkl, rs->n * sizeof(*new_hkl));
+    }
+    rs->u = new_u;
+    rs->v = new_v;
+    rs->intensity = new_intensity;
+    rs->hkl = new_hkl;
+    rs->cap = cap;
+
+    return true;
+}
+
+
+// Carve room for cap layers from the space arena, carrying over the current ones
+static bool rs_carve_layers(ReciprocalSpace *rs, size_t cap) {
+    RSLayer *new_layers = arena_alloc(&rs->arena, cap * sizeof(*new_layers));
+    if (!new_layers) { return false; }
+
+    if (rs->n_layers) { memcpy(new_layers, rs->layers, rs->n_layers * sizeof(*new_layers)); }
+    rs->layers = new_layers;
+    rs->layers_cap = cap;
+
+    return true;
+}
+
+
+// Make room for at least n points; capacity grows geometrically and is never given back,
+//  so steady-state regeneration carves the same arena blocks without touching the heap
+bool rs_reserve(ReciprocalSpace *rs, size_t n) {
+    if (!rs) { return false; }
+
+    if (n <= rs->cap) { return true; }
+
+    size_t cap = rs->cap ? rs->cap : 256;
+    while (cap < n) {
+        if (cap > SIZE_MAX / 2) { return false; }
+        cap *= 2;
+    }
+    if (cap > SIZE_MAX / sizeof(RelpReal) || cap > SIZE_MAX / sizeof(RelpLabel)) { return false; }
+
+    return rs_carve_points(rs, cap);
+}
+
+
+// Set the point count (contents beyond the previous count are unspecified)
 bool rs_resize(ReciprocalSpace *rs, size_t n, HKL zone) {
     if (!rs) { return false; }
 
     rs->zone = zone;
 
-    if (rs->n == n) {
-        return true;
-    }
+    if (!rs_reserve(rs, n)) { return false; }
+    rs->n = n;
 
-    if (n == 0) {
-        free(rs->pts);
-        rs->pts = NULL;
-        rs->n = 0;
-        return true;
+    return true;
+}
+
+
+// Drop all points and layers and set the zone
+//  The arena is rewound, keeping every block it grew, and the arrays carved again at their previous
+//  capacities, so the buffers outgrown during the last generation are reclaimed in one step and a
+//  generation of the same size lands in the same blocks without touching the heap
+bool rs_clear(ReciprocalSpace *rs, HKL zone) {
+    if (!rs) { return false; }
+
+    rs->zone = zone;
+    rs->n = 0;
+    rs->n_layers = 0;
+
+    size_t cap = rs->cap, layers_cap = rs->layers_cap;
+    arena_reset(&rs->arena);
+    rs->u = rs->v = rs->intensity = NULL;
+    rs->hkl = NULL;
+    rs->layers = NULL;
+    rs->cap = rs->layers_cap = 0;
+
+    if (cap && !rs_carve_points(rs, cap)) { return false; }
+    if (layers_cap && !rs_carve_layers(rs, layers_cap)) { return false; }
+
+    return true;
+}
+
+
+// Open a new Laue layer block starting at the current end of the point buffer
+bool rs_begin_layer(ReciprocalSpace *rs, int order) {
+    if (!rs) { return false; }
+
+    if (rs->n_layers == rs->layers_cap && !rs_carve_layers(rs, rs->layers_cap ? 2 * rs->layers_cap : 8)) { return false; }
+
+    rs->layers[rs->n_layers++] = (RSLayer){ .order = order, .offset = rs->n, .n = 0 };
+    return true;
+}
+
+
+// Close the most recent layer block; its points are everything pushed since rs_begin_layer
+bool rs_end_layer(ReciprocalSpace *rs) {
+    if (!rs || rs->n_layers == 0) { return false; }
+
+    RSLayer *layer = &rs->layers[rs->n_layers - 1];
+    layer->n = rs->n - layer->offset;
+    return true;
+}
+
+
+// Keep only the first count layers (and their points)
+bool rs_keep_layers(ReciprocalSpace *rs, size_t count) {
+    if (!rs) { return false; }
+
+    if (count < rs->n_layers) {
+        rs->n = rs->layers[count].offset;
+        rs->n_layers = count;
     }
+    return true;
+}
 
-    ReciprocalPoint *new_pts = calloc(n, sizeof(*new_pts));
-    if (!new_pts) {
-        return false; 
+
+// Append a point, growing the buffer only when capacity is exhausted; false if an index does not fit a label
+bool rs_push(ReciprocalSpace *rs, ReciprocalPoint pt) {
+    if (abs(pt.hkl.h) > INT16_MAX || abs(pt.hkl.k) > INT16_MAX || abs(pt.hkl.l) > INT16_MAX) { return false; }
+    if (rs->n == rs->cap && !rs_reserve(rs, rs->n + 1)) { return false; }
+
+    rs->u[rs->n] = pt.u;
+    rs->v[rs->n] = pt.v;
+    rs->intensity[rs->n] = pt.intensity;
+    rs->hkl[rs->n] = (RelpLabel){ (int16_t)pt.hkl.h, (int16_t)pt.hkl.k, (int16_t)pt.hkl.l };
+    rs->n++;
+    return true;
+}
+
+
+// Grow the cache arrays to hold at least n reflections (geometric), carved from the tables arena; only the
+//  hkl set and q vectors built so far are carried over, as nothing else is filled while the set is built
+static bool rc_reserve(ReflectionCache *rc, Arena *tables, size_t n) {
+    if (n <= rc->cap) { return true; }
+
+    size_t cap = rc->cap ? rc->cap : 1024;
+    while (cap < n) {
+        if (cap > SIZE_MAX / 2) { return false; }
+        cap *= 2;
     }
+    if (cap > SIZE_MAX / sizeof(Vec3)) { return false; }
 
-    free(rs->pts);
-    rs->pts = new_pts;
-    rs->n = n;
+    HKL *new_hkl = arena_alloc(tables, cap * sizeof(*new_hkl));
+    Vec3 *new_q = arena_alloc(tables, cap * sizeof(*new_q));
+    double *new_intensity = arena_alloc(tables, cap * sizeof(*new_intensity));
+    int *new_multiplicity = arena_alloc(tables, cap * sizeof(*new_multiplicity));
+    if (!new_hkl || !new_q || !new_intensity || !new_multiplicity) { return false; }
+
+    if (rc->n) {
+        memcpy(new_hkl, rc->hkl, rc->n * sizeof(*new_hkl));
+        memcpy(new_q, rc->q, rc->n * sizeof(*new_q));
+    }
+    rc->hkl = new_hkl;
+    rc->q = new_q;
+    rc->intensity = new_intensity;
+    rc->multiplicity = new_multiplicity;
+    rc->cap = cap;
 
     return true;
 }
 
 
+// Cell of a reflection in the index box, -1 outside it
+static inline long rc_cell(const ReflectionCache *rc, HKL plane) {
+    if (abs(plane.h) > rc->hmax || abs(plane.k) > rc->kmax || abs(plane.l) > rc->lmax) { return -1; }
+
+    size_t nk = 2 * (size_t)rc->kmax + 1;
+    size_t nl = 2 * (size_t)rc->lmax + 1;
+    return (long)(((size_t)(plane.h + rc->hmax) * nk + (size_t)(plane.k + rc->kmax)) * nl + (size_t)(plane.l + rc->lmax));
+}
+
+
+// Slot of a reflection in the index box, -1 outside the sphere (also while |F|^2 is being filled)
+static inline long rc_slot(const ReflectionCache *rc, HKL plane) {
+    long cell = rc_cell(rc, plane);
+    return cell < 0 ? -1 : rc->index[cell];
+}
+
+
+// Slot of a reflection in the cache, or -1 if it lies outside the cached sphere
+long rc_find(const ReflectionCache *rc, HKL plane) {
+    if (!rc || !rc->valid) { return -1; }
+    return rc_slot(rc, plane);
+}
+
+
 void crystal_free(Crystal *crystal) {
     if (!crystal) { return; }
 
+    // Every part keeps its arrays in an arena: the basis and space in their own, the cache and slab index in
+    //  the tables arena, and the part structs and memo table in the crystal's
     basis_atoms_destroy(crystal->basis);
-    rs_destroy(crystal->space); 
+    rs_destroy(crystal->space);
+    arena_free(&crystal->tables);
+    arena_free(&crystal->arena);
     free(crystal);
 
     return;
@@ -113,16 +293,29 @@ void crystal_free(Crystal *crystal) {
 
 
 // Initialize Crystal struct from lattice parameters
+//  Its parts live side by side in the crystal's arena and are released with it
 Crystal* crystal_init(double a, double b, double c, double alpha, double beta, double gamma) {
     Crystal *crystal = calloc(1, sizeof(*crystal));
     if (!crystal) { return NULL; }
 
-    crystal->basis = calloc(1, sizeof(*crystal->basis));
+    crystal->basis = arena_calloc(&crystal->arena, 1, sizeof(*crystal->basis));
     if (!crystal->basis) { crystal_free(crystal); return NULL; }
 
-    crystal->space = calloc(1, sizeof(*crystal->space));
+    crystal->space = arena_calloc(&crystal->arena, 1, sizeof(*crystal->space));
     if (!crystal->space) { crystal_free(crystal); return NULL; }
 
+    crystal->cache = arena_calloc(&crystal->arena, 1, sizeof(*crystal->cache));
+    if (!crystal->cache) { crystal_free(crystal); return NULL; }
+
+    crystal->slab = arena_calloc(&crystal->arena, 1, sizeof(*crystal->slab));
+    if (!crystal->slab) { crystal_free(crystal); return NULL; }
+
+    crystal->memo = arena_calloc(&crystal->arena, 1, sizeof(*crystal->memo));
+    if (!crystal->memo) { crystal_free(crystal); return NULL; }
+
+    crystal->group = arena_calloc(&crystal->arena, 1, sizeof(*crystal->group));
+    if (!crystal->group) { crystal_free(crystal); return NULL; }
+
     crystal->lattice.a = a;
     crystal->lattice.b = b;
     crystal->lattice.c = c;
@@ -136,6 +329,13 @@ Crystal* crystal_init(double a, double b, double c, double alpha, double beta, d
 
 // METHODS ------------------------ //
 
+static double now_ms(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+
 // Construct reciprocal vector basis from conventional basis
 bool rs_basis(Crystal *crystal) {
 	Vec3 a = mat3_col(crystal->lattice.A, 0);
@@ -154,64 +354,490 @@ bool rs_basis(Crystal *crystal) {
 };
 
 
+// |F|^2 of a built-in basis from the parity of (h,k,l) alone (f = 1 per atom), no trig
+static inline double sf_closed_form(SFForm form, HKL p) {
+    switch (form) {
+        case SF_FORM_PRIMITIVE: return 1;
+        case SF_FORM_BODY:      return ((p.h + p.k + p.l) & 1) ? 0 : 4;
+        case SF_FORM_FACE:      return (((p.h + p.k) | (p.h + p.l)) & 1) ? 0 : 16;
+        case SF_FORM_BASE:      return ((p.h + p.k) & 1) ? 0 : 4;
+        case SF_FORM_RHOMBO:    return ((-p.h + p.k + p.l) % 3) ? 0 : 9;
+        default:                return 0;
+    }
+}
+
+
+// sin(theta)/lambda of a reflection from its scattering vector (|q| = 4PI sin(theta) / lambda)
+static inline double sin_theta_over_lambda(Vec3 q) {
+    return v3_magnitude(q) / (4 * PI);
+}
+
+
+// Debye-Waller exponent of atom i, T = exp(-M): M = B s^2 + 2PI^2 sum_ij h_i h_j a*_i a*_j U_ij
+//  (a*_i = |b_i| / 2PI, as B here carries the 2PI)
+static inline double displacement_exponent(const BasisAtoms *bas, size_t i, HKL p, Vec3 q, Mat3 B) {
+    double s = sin_theta_over_lambda(q);
+    double M = bas->Biso ? bas->Biso[i] * s * s : 0;
+    if (!bas->U) { return M; }
+
+    double h[3] = { p.h * v3_magnitude(mat3_col(B, 0)), p.k * v3_magnitude(mat3_col(B, 1)), p.l * v3_magnitude(mat3_col(B, 2)) };
+    const Mat3 *U = &bas->U[i];
+    return M + 0.5 * (h[0] * h[0] * U->M[0][0] + h[1] * h[1] * U->M[1][1] + h[2] * h[2] * U->M[2][2] +
+                      2 * (h[0] * h[1] * U->M[0][1] + h[0] * h[2] * U->M[0][2] + h[1] * h[2] * U->M[1][2]));
+}
+
+
+// Do atoms i and j vibrate alike (symmetry mates, every atom of a built-in basis)? They then share T
+static inline bool same_displacement(const BasisAtoms *bas, size_t i, size_t j) {
+    if (bas->Biso && bas->Biso[i] != bas->Biso[j]) { return false; }
+    return !bas->U || memcmp(&bas->U[i], &bas->U[j], sizeof(Mat3)) == 0;
+}
+
+
+// q = h a* + k b* + l c*
+static inline Vec3 scattering_vector(Mat3 B, HKL plane) {
+    return v3_add(
+        v3_add(v3_scale(mat3_col(B, 0), (double)plane.h),
+               v3_scale(mat3_col(B, 1), (double)plane.k)),
+               v3_scale(mat3_col(B, 2), (double)plane.l)
+    );
+}
+
+
+// |F|^2 of one reflection, summed atom by atom with cexp: the reference the cached and batched paths are
+//  checked against. Refreshes the form-factor tables itself, so it suits single lookups, not loops
 double structure_factor(Crystal *crystal, HKL plane) {
+    BasisAtoms *bas = crystal->basis;
+    Vec3 q = scattering_vector(crystal->lattice.B, plane);
+    double s = sin_theta_over_lambda(q);
+    if (!ff_update(&bas->ff, bas->Z, bas->n, s)) { return 0; }
+
+    // Built-in cells hold a single element vibrating alike, so |f(s) T|^2 factors out of the closed form
+    if (bas->form != SF_FORM_GENERIC && bas->ff.n <= 1) {
+        double complex f = bas->ff.n ? ff_lookup(&bas->ff, 0, s) + bas->ff.fp[0] + I * bas->ff.fpp[0] : 1;
+        double T = bas->n ? exp(-displacement_exponent(bas, 0, plane, q, crystal->lattice.B)) : 1;
+        return sf_closed_form(bas->form, plane) * (creal(f) * creal(f) + cimag(f) * cimag(f)) * T * T;
+    }
+
+    // f0(s) + f' + i f'' (the dispersion terms are those of the radiation last given to the tables)
+    double complex f_elem[FF_MAX_ELEMENTS];
+    for (size_t e = 0; e < bas->ff.n; e++) { f_elem[e] = ff_lookup(&bas->ff, e, s) + bas->ff.fp[e] + I * bas->ff.fpp[e]; }
+
+    // A run of atoms with equal displacement parameters shares one exponential
     double complex F = 0 + 0 * I; 
-    Vec3 atom;
-    int Z;
-    double f = 1.0;
-    for(size_t i = 0; i < crystal->basis->n; i++) {
-        atom = crystal->basis->pos[i];
-        double phase = 2 * PI * v3_dot(atom, hkl_to_v3(plane));
-        // if (crystal->basis->Z) {
-        //     f = (double)crystal->basis->Z[i];    // scattering factor (approximated as atomic number)
-        // }
-        F += f * cexp(I * phase); 
+    double T = 1;
+    for(size_t i = 0; i < bas->n; i++) {
+        if (i == 0 || !same_displacement(bas, i, i - 1)) { T = exp(-displacement_exponent(bas, i, plane, q, crystal->lattice.B)); }
+
+        double phase = 2 * PI * v3_dot(bas->pos[i], hkl_to_v3(plane));
+        double complex f = f_elem[ff_index(&bas->ff, bas->Z ? bas->Z[i] : 0)];
+        F += f * T * cexp(I * phase); 
     }  
 
     return pow(cabs(F), 2);
 }
 
 
-// Generate reciprocal lattice points from a Crystal struct chosen plane normal
-bool generate_relp(Crystal *crystal, HKL zone) {
-    // Normal vector cannot be zero
-    if ( !crystal || (zone.h == 0 && zone.k == 0 && zone.l == 0) ) {
-        return false; 
+// Radius of the limiting sphere |q| <= 2k = 4PI / lambda (physics convention, 1/Angstrom)
+double limiting_radius(double wavelength) {
+    if (wavelength <= 0) { return 0; }
+    return 4 * PI / wavelength;
+}
+
+
+// Integer range of x with a*x^2 + 2*b*x + c <= 0, for a > 0 (returns false if empty)
+//  Used for row bounds of lattice points inside an ellipse/ellipsoid
+static bool quad_range(double a, double b, double c, int *lo, int *hi) {
+    double disc = b * b - a * c;
+    if (disc < 0) { return false; }
+
+    double root = sqrt(disc);
+    double slack = 1e-9 * (1.0 + fabs(b) + root) / a;
+
+    *lo = (int)ceil((-b - root) / a - slack);
+    *hi = (int)floor((-b + root) / a + slack);
+    return *lo <= *hi;
+}
+
+
+// Build the 3D reflection set: every (h,k,l) with |q| <= 4PI/lambda and its q vector
+//  (|F|^2 is filled separately by rc_structure_factors, so a basis change keeps the hkl set)
+//  Rows are bounded exactly from the reciprocal metric G = B^T B: h from (G^-1)_11, k from the
+//  Schur complement of G33 at fixed h, and l from the full quadratic at fixed (h,k)
+bool rc_build(Crystal *crystal, double wavelength) {
+    if (!crystal || !crystal->cache || !crystal->basis) { return false; }
+
+    // A new hkl set: rewind the tables arena (its blocks are kept) and carve the cache afresh; the slab index
+    //  is carved again by its next build
+    ReflectionCache *rc = crystal->cache;
+    rc->valid = false;
+    rc->n = 0;
+    arena_reset(&crystal->tables);
+    rc->hkl = NULL;
+    rc->q = NULL;
+    rc->intensity = NULL;
+    rc->multiplicity = NULL;
+    rc->index = NULL;
+    rc->cap = 0;
+    if (crystal->slab) {
+        SlabIndex *si = crystal->slab;
+        si->entries = NULL;
+        si->q = (Vec3SoA){ NULL, NULL, NULL };
+        si->n = si->cap = 0;
+        si->valid = false;
     }
 
-    // Reciprocal vectors 
-    Vec3 b1 = mat3_col(crystal->lattice.B, 0);    
-    Vec3 b2 = mat3_col(crystal->lattice.B, 1);    
-    Vec3 b3 = mat3_col(crystal->lattice.B, 2);    
+    double q_max = limiting_radius(wavelength);
+    if (q_max <= 0) { return false; }
+    double r2 = q_max * q_max;
+
+    Mat3 G = mat3_metric(crystal->lattice.B);
+
+    // |h| <= q_max * |a| / 2PI (likewise for k, l), since h = q . a / 2PI
+    rc->hmax = (int)floor(q_max * v3_magnitude(mat3_col(crystal->lattice.A, 0)) / (2 * PI) + 1e-9);
+    rc->kmax = (int)floor(q_max * v3_magnitude(mat3_col(crystal->lattice.A, 1)) / (2 * PI) + 1e-9);
+    rc->lmax = (int)floor(q_max * v3_magnitude(mat3_col(crystal->lattice.A, 2)) / (2 * PI) + 1e-9);
+
+    size_t nk = 2 * (size_t)rc->kmax + 1;
+    size_t nl = 2 * (size_t)rc->lmax + 1;
+    size_t cells = (2 * (size_t)rc->hmax + 1) * nk * nl;
+    if (cells > SIZE_MAX / sizeof(*rc->index)) { return false; }
+    rc->index = arena_alloc(&crystal->tables, cells * sizeof(*rc->index));
+    if (!rc->index) { return false; }
+    for (size_t i = 0; i < cells; i++) { rc->index[i] = -1; }
+
+    // Sphere volume over reciprocal cell volume estimates the final count
+    double vol_r = v3_dot(mat3_col(crystal->lattice.B, 0), v3_cross(mat3_col(crystal->lattice.B, 1), mat3_col(crystal->lattice.B, 2)));
+    if (!rc_reserve(rc, &crystal->tables, (size_t)(4.0 / 3.0 * PI * r2 * q_max / fabs(vol_r)) + nk * nl)) { return false; }
+
+    Vec3 b1 = mat3_col(crystal->lattice.B, 0);
+    Vec3 b2 = mat3_col(crystal->lattice.B, 1);
+    Vec3 b3 = mat3_col(crystal->lattice.B, 2);
+
+    // Schur complement of G33: minimum over real l of |q|^2 at fixed (h,k)
+    double s11 = G.M[0][0] - G.M[0][2] * G.M[0][2] / G.M[2][2];
+    double s12 = G.M[0][1] - G.M[0][2] * G.M[1][2] / G.M[2][2];
+    double s22 = G.M[1][1] - G.M[1][2] * G.M[1][2] / G.M[2][2];
+
+    int h, k, l, k_lo, k_hi, l_lo, l_hi;
+    for (h = -rc->hmax; h <= rc->hmax; h++) {
+        if (!quad_range(s22, s12 * h, s11 * h * h - r2, &k_lo, &k_hi)) { continue; }
+        if (k_lo < -rc->kmax) { k_lo = -rc->kmax; }
+        if (k_hi > rc->kmax) { k_hi = rc->kmax; }
+
+        for (k = k_lo; k <= k_hi; k++) {
+            double c_hk = G.M[0][0] * h * h + 2 * G.M[0][1] * h * k + G.M[1][1] * k * k - r2;
+            double b_hk = G.M[0][2] * h + G.M[1][2] * k;
+            if (!quad_range(G.M[2][2], b_hk, c_hk, &l_lo, &l_hi)) { continue; }
+            if (l_lo < -rc->lmax) { l_lo = -rc->lmax; }
+            if (l_hi > rc->lmax) { l_hi = rc->lmax; }
+
+            size_t row = ((size_t)(h + rc->hmax) * nk + (size_t)(k + rc->kmax)) * nl + (size_t)rc->lmax;
+            for (l = l_lo; l <= l_hi; l++) {
+                HKL plane = (HKL){h, k, l};
+                if (sg_absent(crystal->group, plane)) { continue; }   // never cached, never given an |F|^2
+
+                if (rc->n == rc->cap && !rc_reserve(rc, &crystal->tables, rc->n + 1)) { return false; }
+
+                rc->hkl[rc->n] = plane;
+                rc->q[rc->n] = v3_add(
+                    v3_add(v3_scale(b1, (double)h),
+                           v3_scale(b2, (double)k)),
+                           v3_scale(b3, (double)l)
+                );
+                rc->index[row + l] = (int)rc->n;
+                rc->n++;
+            }
+        }
+    }
 
-    Vec3 zone_rs = v3_add(
-        v3_add(v3_scale(b1, (double)zone.h),
-               v3_scale(b2, (double)zone.k)),
-               v3_scale(b3, (double)zone.l)
-    );
+    rc->wavelength = wavelength;
 
-    zone_rs = v3_normalize(zone_rs);
+    return true;
+}
+
+
+// Group the cached reflections into orbits of the Laue group, walking the index box from 000 to its end and
+//  then from its start (cache order): the first reflection met of an orbit is its representative, so in the
+//  upper half wherever that can be. The walk reads a bitmap of the unassigned cells instead of the reflection
+//  arrays, so only representatives cost anything. Fills rc->multiplicity and, if asked, orbit (slot of each
+//  reflection's representative): the index cell of each image holds its representative meanwhile and gets
+//  its slot back in one pass in cache order. Returns the number of orbits, 0 if memory runs out
+static size_t rc_orbits(ReflectionCache *rc, const LaueGroup *laue, int *orbit) {
+    // Without symmetry beyond Friedel's law the orbits are {h} or {h, -h}: no walk is needed
+    static const int inversion[3][3] = { {-1, 0, 0}, {0, -1, 0}, {0, 0, -1} };
+    long mid = rc_slot(rc, (HKL){0, 0, 0});
+    if (mid >= 0 && (laue->n == 1 || (laue->n == 2 && memcmp(laue->M[1], inversion, sizeof(inversion)) == 0))) {
+        size_t n_reps = 0;
+        for (size_t i = 0; i < rc->n; i++) {
+            long mate = laue->n == 2 && i != (size_t)mid ? rc_slot(rc, hkl_scale(rc->hkl[i], -1)) : -1;
+            bool rep = mate < 0 || i > (size_t)mid;
+            if (orbit) { orbit[i] = rep ? (int)i : (int)mate; }
+            rc->multiplicity[i] = rep ? 1 + (mate >= 0) : 0;
+            n_reps += rep;
+        }
+        return n_reps;
+    }
 
-    int z_h = zone.h;
-    int z_k = zone.k;
-    int z_l = zone.l;
+    size_t nk = 2 * (size_t)rc->kmax + 1;
+    size_t nl = 2 * (size_t)rc->lmax + 1;
+    size_t cells = (2 * (size_t)rc->hmax + 1) * nk * nl;
+    size_t words = (cells + 63) / 64;
 
-    Vec3 q;
+    uint64_t *open = malloc(words * sizeof(*open));
+    if (!open) { return 0; }
 
-    int H = 15;
-    int h,k,l;
-    int count = 0;
-    for (h = -H; h <= H; h++) {
-        for (k = -H; k <= H; k++) {
-            for (l = -H; l <= H; l++) {
-                if (h * z_h + k * z_k + l * z_l == 0) {
-                    count++;
-                }
+    for (size_t w = 0; w < words; w++) {
+        uint64_t bits = 0;
+        for (size_t b = 0; b < 64 && w * 64 + b < cells; b++) { bits |= (uint64_t)(rc->index[w * 64 + b] >= 0) << b; }
+        open[w] = bits;
+    }
+    memset(rc->multiplicity, 0, rc->n * sizeof(*rc->multiplicity));
+
+    // 000 is the centre cell; its word comes first for the bits from it on and last for those below it
+    int hmax = rc->hmax, kmax = rc->kmax, lmax = rc->lmax;
+    int *index = rc->index;
+    size_t centre = (cells - 1) / 2;
+    size_t n_reps = 0;
+    for (size_t s = 0; s <= words; s++) {
+        size_t w = (centre / 64 + s) % words;
+        uint64_t mask = s == 0 ? ~(uint64_t)0 << (centre % 64) : ~(uint64_t)0;
+
+        uint64_t bits;
+        while ((bits = open[w] & mask) != 0) {
+            size_t b = 0;
+            while (!((bits >> b) & 0xff)) { b += 8; }
+            while (!((bits >> b) & 1)) { b++; }
+
+            int rep = index[w * 64 + b];
+            HKL p = rc->hkl[rep];
+
+            // Images can leave the cache only across a space-group absence; half of them are usually
+            //  taken already, so they are counted without branching
+            int count = 0;
+            for (size_t g = 0; g < laue->n; g++) {
+                HKL t = laue_apply(laue->M[g], p);
+                if (abs(t.h) > hmax || abs(t.k) > kmax || abs(t.l) > lmax) { continue; }
+
+                size_t image = ((size_t)(t.h + hmax) * nk + (size_t)(t.k + kmax)) * nl + (size_t)(t.l + lmax);
+                uint64_t bit = (uint64_t)1 << (image % 64);
+                int taken = (open[image / 64] & bit) != 0;
+                open[image / 64] &= ~bit;
+                if (orbit) { index[image] = taken ? rep : index[image]; }
+                count += taken;
+            }
+            rc->multiplicity[rep] = count;
+            n_reps++;
+        }
+    }
+
+    for (size_t c = 0, i = 0; orbit && c < cells; c++) {
+        if (index[c] < 0) { continue; }
+        orbit[i] = index[c];
+        index[c] = (int)i++;
+    }
+
+    free(open);
+    return n_reps;
+}
+
+
+// Direct sum for the orbit representatives only, then copied to the other members of their orbits
+//  In anomalous mode each upper-half representative also yields |F(-h)|^2, which belongs to the orbit of -h;
+//  every lower-half representative heads such an orbit, so one Friedel pass covers them all
+//  Representatives are gathered into compact arrays for the engine, unless they are the whole upper half
+//  (a basis without symmetry beyond Friedel's law), which it then reads where it lies
+static bool rc_engine_orbits(ReflectionCache *rc, const SFAtoms *atoms, const int *orbit, size_t n_reps, size_t mid, bool anomalous) {
+    size_t upper = 0;
+    for (size_t i = mid; i < rc->n; i++) { upper += orbit[i] == (int)i; }
+    size_t n = anomalous ? upper : n_reps;
+    bool in_place = n == rc->n - mid && upper == n;
+
+    size_t *slot = NULL;
+    HKL *hkl = rc->hkl + mid;
+    Vec3 *q = rc->q + mid;
+    double *intensity = rc->intensity + mid;
+    double *mates = anomalous ? malloc(n * sizeof(*mates)) : NULL;
+    bool ok = mates || !anomalous;
+
+    if (ok && !in_place) {
+        slot = malloc(n * sizeof(*slot));
+        hkl = malloc(n * sizeof(*hkl));
+        q = malloc(n * sizeof(*q));
+        intensity = malloc(n * sizeof(*intensity));
+        ok = slot && hkl && q && intensity;
+
+        size_t r = 0;
+        for (size_t w = 0; ok && w < rc->n && r < n; w++) {
+            size_t i = w < rc->n - mid ? mid + w : w - (rc->n - mid);
+            if (orbit[i] != (int)i) { continue; }
+            slot[r] = i;
+            hkl[r] = rc->hkl[i];
+            q[r] = rc->q[i];
+            r++;
+        }
+    }
+
+    if (ok && anomalous) {
+        ok = sf_engine_run_friedel(atoms, hkl, q, n, intensity, mates);
+        for (size_t r = 0; ok && r < n; r++) {
+            long s = rc_slot(rc, hkl_scale(hkl[r], -1));
+            if (s >= 0) { rc->intensity[orbit[s]] = mates[r]; }
+        }
+    }
+    else if (ok) { ok = sf_engine_run(atoms, hkl, q, n, intensity); }
+    if (ok) { rc->sf_summed += n; }
+
+    if (ok) {
+        for (size_t r = 0; !in_place && r < n; r++) { rc->intensity[slot[r]] = intensity[r]; }
+        for (size_t i = 0; i < rc->n; i++) { rc->intensity[i] = rc->intensity[orbit[i]]; }
+    }
+
+    if (!in_place) {
+        free(slot);
+        free(hkl);
+        free(q);
+        free(intensity);
+    }
+    free(mates);
+    return ok;
+}
+
+
+// |F|^2 of every cached reflection from the packed atoms: by FFT for large cells, else by the direct sum over
+//  one representative per Laue orbit; fills the multiplicities either way
+static bool rc_atoms_structure_factors(ReflectionCache *rc, const SFAtoms *atoms, const LaueGroup *laue, size_t mid, bool anomalous) {
+    // Large cells: one FFT of the gridded atoms gives every F(hkl) of the box, Friedel mates included
+    if (sf_grid_preferred(atoms, rc->hkl, rc->n, rc->n / laue->n) && sf_grid_run(atoms, rc->hkl, rc->q, rc->n, rc->intensity)) {
+        return rc_orbits(rc, laue, NULL) > 0;
+    }
+
+    int *orbit = malloc(rc->n * sizeof(*orbit));
+    if (!orbit) { return false; }
+
+    size_t n_reps = rc_orbits(rc, laue, orbit);
+    bool ok = n_reps > 0 && rc_engine_orbits(rc, atoms, orbit, n_reps, mid, anomalous);
+    free(orbit);
+    return ok;
+}
+
+
+// Direct sum for the n cached reflections at the given slots only
+static bool rc_engine_slots(ReflectionCache *rc, const SFAtoms *atoms, const int *slot, size_t n) {
+    HKL *hkl = malloc(n * sizeof(*hkl));
+    Vec3 *q = malloc(n * sizeof(*q));
+    double *intensity = malloc(n * sizeof(*intensity));
+    bool ok = hkl && q && intensity;
+
+    for (size_t r = 0; ok && r < n; r++) {
+        hkl[r] = rc->hkl[slot[r]];
+        q[r] = rc->q[slot[r]];
+    }
+    if (ok) { ok = sf_engine_run(atoms, hkl, q, n, intensity); }
+    if (ok) { rc->sf_summed += n; }
+    for (size_t r = 0; ok && r < n; r++) { rc->intensity[slot[r]] = intensity[r]; }
+
+    free(hkl);
+    free(q);
+    free(intensity);
+    return ok;
+}
+
+
+// Fill |F|^2 for every cached reflection from the current basis atoms; the cache is usable afterwards
+//  Reflections related by the Laue symmetry of the basis (laue.c) share |F|^2, and their orbits give each
+//  reflection's multiplicity. Built-in cells use their closed form times |f(s) T|^2, cheap enough to take
+//  every reflection as it comes; other bases go through the (vectorized) engine in sf_engine.c for one
+//  representative per orbit, which advances each atom's Debye-Waller factor T along l by recurrence, or,
+//  for cells with so many atoms that it is cheaper, through one FFT of the atoms on a grid (sf_grid.c),
+//  which yields the whole index box anyway. Either way each reflection costs one form-factor table lookup
+//  per element. In anomalous mode F(hkl) and F(-h-k-l) differ, but both come out of one engine pass
+//  Atom sums are memoized across passes (sf_memo.c): a basis and lattice seen before only sum the
+//  reflections the memo lacks, and nothing at all when it has them all
+bool rc_structure_factors(Crystal *crystal) {
+    if (!crystal || !crystal->cache || !crystal->basis) { return false; }
+
+    ReflectionCache *rc = crystal->cache;
+    BasisAtoms *bas = crystal->basis;
+
+    // Until this pass completes the cache holds no usable |F|^2, whatever an earlier pass left
+    rc->valid = false;
+    rc->sf_summed = 0;
+    if (!ff_update(&bas->ff, bas->Z, bas->n, 1 / rc->wavelength)) { return false; }
+    ff_set_wavelength(&bas->ff, bas->anomalous ? rc->wavelength : 0);
+
+    // The cache is in (h,k,l) order and centrosymmetric, so the slots from 000 on hold one of each Friedel pair
+    long mid = rc_slot(rc, (HKL){0, 0, 0});
+    if (mid < 0) { return false; }
+
+    LaueGroup laue;
+    if (!laue_group(&laue, bas, &crystal->lattice, !bas->anomalous)) { return false; }
+
+    if (bas->form != SF_FORM_GENERIC && bas->ff.n <= 1) {
+        if (rc_orbits(rc, &laue, NULL) == 0) { return false; }
+
+        // One element: Friedel's law still holds, the dispersion terms only change |f|
+        bool unit = bas->ff.n == 0 || bas->ff.Z[0] == 0;
+        bool at_rest = bas->n == 0 || (bas->Biso[0] == 0 && memcmp(&bas->U[0], &(Mat3){0}, sizeof(Mat3)) == 0);
+        for (size_t i = 0; i < rc->n; i++) {
+            double intensity = sf_closed_form(bas->form, rc->hkl[i]);
+            if (!unit && intensity != 0) {
+                double f = ff_lookup(&bas->ff, 0, sin_theta_over_lambda(rc->q[i])) + bas->ff.fp[0];
+                intensity *= f * f + bas->ff.fpp[0] * bas->ff.fpp[0];
+            }
+            if (!at_rest && intensity != 0) { intensity *= exp(-2 * displacement_exponent(bas, 0, rc->hkl[i], rc->q[i], crystal->lattice.B)); }
+            rc->intensity[i] = intensity;
+        }
+    }
+    else {
+        if (!sf_atoms_pack(&bas->soa, bas, crystal->lattice.B)) { return false; }
+
+        // Consult the memo whenever it has stored this fingerprint before; a basis it has not seen is summed
+        //  outright and stored for the next time it comes back
+        SFMemo *memo = crystal->memo;
+        bool memoize = memo && sf_memo_begin(memo, &crystal->arena, rc->n);
+        uint64_t key = memoize ? sf_memo_fingerprint(bas, &crystal->lattice, rc->wavelength) : 0;
+
+        int *missing = memoize && sf_memo_seen(memo, key) ? malloc(rc->n * sizeof(*missing)) : NULL;
+        size_t n_missing = rc->n;
+        if (missing) {
+            n_missing = 0;
+            for (size_t i = 0; i < rc->n; i++) {
+                if (!sf_memo_lookup(memo, key, rc->hkl[i], &rc->intensity[i])) { missing[n_missing++] = (int)i; }
             }
         }
+
+        bool ok;
+        if (missing && n_missing * laue.n <= rc->n) {
+            // Fewer new reflections than orbits: sum just those
+            ok = rc_orbits(rc, &laue, NULL) > 0 && rc_engine_slots(rc, &bas->soa, missing, n_missing);
+            for (size_t r = 0; ok && r < n_missing; r++) { sf_memo_store(memo, key, rc->hkl[missing[r]], rc->intensity[missing[r]]); }
+        }
+        else {
+            ok = rc_atoms_structure_factors(rc, &bas->soa, &laue, (size_t)mid, bas->anomalous);
+            for (size_t i = 0; ok && memoize && i < rc->n; i++) { sf_memo_store(memo, key, rc->hkl[i], rc->intensity[i]); }
+        }
+        free(missing);
+        if (!ok) { return false; }
     }
 
-    if (!rs_resize(crystal->space, count, zone)) { return false; }
+    rc->valid = true;
+    return true;
+}
+
+
+Mat3 zone_frame(const Lattice *lattice, HKL zone) {
+    Vec3 b1 = mat3_col(lattice->B, 0);    
+    Vec3 b2 = mat3_col(lattice->B, 1);    
+    Vec3 b3 = mat3_col(lattice->B, 2);    
+
+    Vec3 zone_rs = v3_add(
+        v3_add(v3_scale(b1, (double)zone.h),
+               v3_scale(b2, (double)zone.k)),
+               v3_scale(b3, (double)zone.l)
+    );
+
+    zone_rs = v3_normalize(zone_rs);
 
     Vec3 e1 = v3_unit_normal(zone_rs);
     Vec3 e2 = v3_cross(zone_rs, e1);
@@ -222,192 +848,742 @@ bool generate_relp(Crystal *crystal, HKL zone) {
         e2 = v3_scale(e2, -1.0);  
     }
 
-    int n = 0;
-    for (h = -H; h <= H; h++) {
-        for (k = -H; k <= H; k++) {
-            for (l = -H; l <= H; l++) {
-                if (h * z_h + k * z_k + l * z_l == 0) {
-                    q = v3_add(
-                        v3_add(v3_scale(b1, (double)h),
-                           v3_scale(b2, (double)k)),
-                           v3_scale(b3, (double)l)
-                    );
-                    HKL plane = (HKL){h, k, l};
-                    crystal->space->pts[n].hkl = plane; 
-                    crystal->space->pts[n].u = v3_dot(q, e1);
-                    crystal->space->pts[n].v = v3_dot(q, e2);
-                    crystal->space->pts[n].intensity = structure_factor(crystal, plane);
-                    n++;
-                }
+    return v3_to_mat3(e1, e2, zone_rs);
+}
+
+
+// |F|^2 of a built-in cell's reflection: its closed form times |f(s) T|^2 of the single element
+static inline double sf_closed_intensity(const BasisAtoms *bas, HKL p, Vec3 q, Mat3 B) {
+    double intensity = sf_closed_form(bas->form, p);
+    if (intensity == 0) { return 0; }
+
+    if (bas->ff.n > 0 && bas->ff.Z[0] != 0) {
+        double f = ff_lookup(&bas->ff, 0, sin_theta_over_lambda(q)) + bas->ff.fp[0];
+        intensity *= f * f + bas->ff.fpp[0] * bas->ff.fpp[0];
+    }
+    if (bas->n) { intensity *= exp(-2 * displacement_exponent(bas, 0, p, q, B)); }
+    return intensity;
+}
+
+
+// |F|^2 of a batch of reflections the cache cannot serve, with the form factors (and, for a generic basis,
+//  the packed atoms) already current: closed form for built-in cells, else one engine pass
+static bool sf_batch(const Crystal *crystal, const HKL *hkl, const Vec3 *q, size_t n, double *intensity) {
+    const BasisAtoms *bas = crystal->basis;
+    if (bas->form != SF_FORM_GENERIC && bas->ff.n <= 1) {
+        for (size_t i = 0; i < n; i++) { intensity[i] = sf_closed_intensity(bas, hkl[i], q[i], crystal->lattice.B); }
+        return true;
+    }
+    return sf_engine_run(&bas->soa, hkl, q, n, intensity);
+}
+
+
+// Stream the reflections of Laue layer h*u + k*v + l*w = order inside the limiting sphere to a consumer,
+//  RELP_CHUNK points at a time from a fixed buffer (order 0 = ZOLZ, +-1 = FOLZ, +-2 = SOLZ, ...)
+//  Layer points are (h,k,l) = order*t + m*p1 + n*p2, where t . [uvw] = 1 and p1, p2 span the zone plane;
+//  the offset order*t splits into a part normal to the plane (the layer height) and an in-plane shift
+//  of the ellipse, so only points inside the sphere are visited
+//  Returns false on invalid input or when the consumer stops the stream
+bool stream_layer(Crystal *crystal, HKL zone, int order, double wavelength, RelpConsumer consume, void *user) {
+    if ( !crystal || !consume || (zone.h == 0 && zone.k == 0 && zone.l == 0) ) {
+        return false; 
+    }
+
+    double q_max = limiting_radius(wavelength);
+    if (q_max <= 0) { return false; }
+
+    // Reduced integer basis of the zone plane (short in reciprocal space, so rows are compact)
+    Mat3 G = mat3_metric(crystal->lattice.B);
+    HKL p1, p2, t;
+    if (!hkl_zone_basis(zone, &p1, &p2)) { return false; }
+    if (!hkl_zone_offset(zone, &t)) { return false; }
+    hkl_reduce_basis(&p1, &p2, G);
+
+    // 2D metric of the plane: |m*P1 + n*P2|^2 = g11*m^2 + 2*g12*m*n + g22*n^2
+    double g11 = hkl_metric_dot(p1, p1, G);
+    double g12 = hkl_metric_dot(p1, p2, G);
+    double g22 = hkl_metric_dot(p2, p2, G);
+    double det = g11 * g22 - g12 * g12;
+    if (det <= 0) { return false; }
+
+    // Layer offset q0 = order * B t = (alpha*P1 + beta*P2) + height, with height normal to the plane
+    HKL origin = hkl_scale(t, order);
+    double o1 = hkl_metric_dot(origin, p1, G);
+    double o2 = hkl_metric_dot(origin, p2, G);
+    double alpha = ( g22 * o1 - g12 * o2) / det;
+    double beta  = (-g12 * o1 + g11 * o2) / det;
+    double height2 = hkl_metric_dot(origin, origin, G) - (alpha * o1 + beta * o2);
+
+    // Radius left for the in-plane part; the layer misses the sphere entirely if it is negative
+    double r2 = q_max * q_max - height2;
+    if (r2 < 0) { return true; }
+
+    // Extent of the ellipse in m is sqrt(r2 * (g^-1)_11), centred on -alpha
+    double M = sqrt(r2 * g22 / det);
+    int m_lo = (int)ceil(-alpha - M - 1e-9);
+    int m_hi = (int)floor(-alpha + M + 1e-9);
+
+    // Projection folded into the 2x3 matrix P = [e1 e2]^T B, so (u, v) = P (h,k,l); a step along a row
+    //  (hkl += p2) moves a point by the constant P p2, and each row starts again from P (h,k,l) exactly
+    Mat3 frame = zone_frame(&crystal->lattice, zone);
+    Vec3 e1 = mat3_col(frame, 0);
+    Vec3 e2 = mat3_col(frame, 1);
+    Vec3 P_u = (Vec3){ v3_dot(e1, mat3_col(crystal->lattice.B, 0)), v3_dot(e1, mat3_col(crystal->lattice.B, 1)), v3_dot(e1, mat3_col(crystal->lattice.B, 2)) };
+    Vec3 P_v = (Vec3){ v3_dot(e2, mat3_col(crystal->lattice.B, 0)), v3_dot(e2, mat3_col(crystal->lattice.B, 1)), v3_dot(e2, mat3_col(crystal->lattice.B, 2)) };
+    RelpReal du = (RelpReal)v3_dot(P_u, hkl_to_v3(p2));
+    RelpReal dv = (RelpReal)v3_dot(P_v, hkl_to_v3(p2));
+
+    // Without a cache for this radiation every |F|^2 is summed here, a chunk at a time through the engine,
+    //  so the form factors are set up and the atoms packed once for the whole layer
+    const ReflectionCache *rc = crystal->cache;
+    BasisAtoms *bas = crystal->basis;
+    bool cached = rc->valid && rc->wavelength == wavelength;
+    if (!cached) {
+        if (!ff_update(&bas->ff, bas->Z, bas->n, 1 / wavelength)) { return false; }
+        ff_set_wavelength(&bas->ff, bas->anomalous ? wavelength : 0);
+        if ((bas->form == SF_FORM_GENERIC || bas->ff.n > 1) && !sf_atoms_pack(&bas->soa, bas, crystal->lattice.B)) { return false; }
+    }
+
+    ReciprocalPoint chunk[RELP_CHUNK];
+    size_t n_chunk = 0;
+
+    // Points of the chunk still waiting for their |F|^2
+    HKL pending_hkl[RELP_CHUNK];
+    Vec3 pending_q[RELP_CHUNK];
+    double pending_intensity[RELP_CHUNK];
+    size_t pending_at[RELP_CHUNK];
+    size_t n_pending = 0;
+
+    int m, n, n_lo, n_hi;
+    for (m = m_lo; m <= m_hi; m++) {
+        // g22*(n+beta)^2 + 2*g12*(m+alpha)*(n+beta) + g11*(m+alpha)^2 <= r2, as a quadratic in n
+        double ma = m + alpha;
+        double b_n = g22 * beta + g12 * ma;
+        double c_n = g22 * beta * beta + 2 * g12 * ma * beta + g11 * ma * ma - r2;
+        if (!quad_range(g22, b_n, c_n, &n_lo, &n_hi)) { continue; }
+
+        HKL plane = hkl_add(origin, hkl_add(hkl_scale(p1, m), hkl_scale(p2, n_lo)));
+        RelpReal u = (RelpReal)v3_dot(P_u, hkl_to_v3(plane));
+        RelpReal v = (RelpReal)v3_dot(P_v, hkl_to_v3(plane));
+
+        for (n = n_lo; n <= n_hi; n++, plane = hkl_add(plane, p2), u += du, v += dv) {
+            double intensity = 0;
+
+            // Cached reflections only need their |F|^2 read; anything missing waits for the chunk's batch
+            long slot = cached ? rc_find(rc, plane) : -1;
+            if (slot >= 0) { intensity = rc->intensity[slot]; }
+            else {
+                // Systematic absences are left out of the cache; skip them before computing anything
+                if (sg_absent(crystal->group, plane)) { continue; }
+                pending_hkl[n_pending] = plane;
+                pending_q[n_pending] = scattering_vector(crystal->lattice.B, plane);
+                pending_at[n_pending++] = n_chunk;
+            }
+
+            chunk[n_chunk++] = (ReciprocalPoint){
+                .hkl = plane,
+                .u = u,
+                .v = v,
+                .intensity = (RelpReal)intensity
+            };
+            if (n_chunk == RELP_CHUNK) {
+                if (n_pending && !sf_batch(crystal, pending_hkl, pending_q, n_pending, pending_intensity)) { return false; }
+                for (size_t j = 0; j < n_pending; j++) { chunk[pending_at[j]].intensity = (RelpReal)pending_intensity[j]; }
+                n_pending = 0;
+
+                if (!consume(user, chunk, n_chunk)) { return false; }
+                n_chunk = 0;
             }
         }
     }
-    
+
+    if (n_pending && !sf_batch(crystal, pending_hkl, pending_q, n_pending, pending_intensity)) { return false; }
+    for (size_t j = 0; j < n_pending; j++) { chunk[pending_at[j]].intensity = (RelpReal)pending_intensity[j]; }
+
+    return n_chunk == 0 || consume(user, chunk, n_chunk);
+}
+
+
+// Stream the zero-order zone: every in-plane reflection of [uvw] inside the limiting sphere
+bool stream_relp(Crystal *crystal, HKL zone, double wavelength, RelpConsumer consume, void *user) {
+    return stream_layer(crystal, zone, 0, wavelength, consume, user);
+}
+
+
+// Consumer that appends streamed points to a ReciprocalSpace
+static bool rs_consume(void *user, const ReciprocalPoint *pts, size_t n) {
+    ReciprocalSpace *rs = user;
+    if (!rs_reserve(rs, rs->n + n)) { return false; }
+
+    for (size_t i = 0; i < n; i++) {
+        if (!rs_push(rs, pts[i])) { return false; }
+    }
     return true;
 }
 
 
-bool generate_cell(Crystal *crystal, System sys, BasisType bas) {
-    if (!crystal || !crystal->basis) return false;
+// Append the reflections of one Laue layer to crystal->space as one contiguous block
+bool generate_layer(Crystal *crystal, HKL zone, int order, double wavelength) {
+    if (!crystal || !crystal->space) { return false; }
+
+    ReciprocalSpace *rs = crystal->space;
+    size_t n_layers = rs->n_layers;
+    if (!rs_begin_layer(rs, order)) { return false; }
+
+    // A failed layer is dropped with the points it already received, so the space is left as it was
+    if (!stream_layer(crystal, zone, order, wavelength, rs_consume, rs)) {
+        rs_keep_layers(rs, n_layers);
+        return false;
+    }
+
+    return rs_end_layer(rs);
+}
+
+
+// Generate reciprocal lattice points from a Crystal struct chosen plane normal
+//  Points satisfying the zone law form a 2D integer lattice spanned by p1, p2 (see hkl_zone_basis),
+//  so only in-plane (h,k,l) = m*p1 + n*p2 are visited, and only those inside the limiting sphere;
+//  the zero-order stream is collected into crystal->space
+bool generate_relp(Crystal *crystal, HKL zone, double wavelength) {
+    // Normal vector cannot be zero
+    if ( !crystal || (zone.h == 0 && zone.k == 0 && zone.l == 0) ) {
+        return false; 
+    }
+
+    // Single pass: reuse the buffer, starting over with the zero-order layer
+    if (!rs_clear(crystal->space, zone)) { return false; }
+
+    return generate_layer(crystal, zone, 0, wavelength);
+}
+
+
+// Append the next higher-order Laue layer of the current zone (order 1, -1, 2, -2, ... after the ZOLZ)
+//  Meant to be called once per frame so FOLZ/SOLZ rings appear progressively
+bool generate_next_layer(Crystal *crystal, double wavelength) {
+    if (!crystal || !crystal->space || crystal->space->n_layers == 0) { return false; }
+
+    int i = (int)crystal->space->n_layers;
+    int order = (i % 2 == 1) ? (i + 1) / 2 : -(i / 2);
+
+    return generate_layer(crystal, crystal->space->zone, order, wavelength);
+}
+
+
+static int slab_entry_cmp(const void *a, const void *b) {
+    double ka = ((const SlabEntry *)a)->key;
+    double kb = ((const SlabEntry *)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+
+// Carve index arrays for at least n entries from the tables arena (never shrinks; the contents are not kept)
+static bool slab_index_reserve(SlabIndex *si, Arena *tables, size_t n) {
+    if (n <= si->cap) { return true; }
+
+    SlabEntry *new_entries = arena_alloc(tables, n * sizeof(*new_entries));
+    double *new_x = arena_alloc(tables, n * sizeof(*new_x));
+    double *new_y = arena_alloc(tables, n * sizeof(*new_y));
+    double *new_z = arena_alloc(tables, n * sizeof(*new_z));
+    if (!new_entries || !new_x || !new_y || !new_z) { return false; }
+
+    si->entries = new_entries;
+    si->q = (Vec3SoA){ new_x, new_y, new_z };
+    si->cap = n;
+
+    return true;
+}
+
+
+// (Re)key the slab index for a new normal; a slight tilt barely changes the order, so an existing
+//  index is re-sorted by insertion sort in O(n + displacements) instead of a full sort
+//  Keys move by at most |n - n0| q_max and the densest cut through the sphere holds about 3/4 n / q_max
+//  of them per unit key, so an entry passes at most ~1.5 n |n - n0| others; beyond SLAB_RESORT_SHIFT
+//  the insertion sort heads for O(n^2) and the index is sorted afresh
+//  The index keeps its own SoA copy of q in key order, so keys come from the batch dot product and the
+//  insertion sort carries q along; a full sort gathers it from the cache afterwards
+static bool slab_index_build(SlabIndex *si, Arena *tables, const ReflectionCache *rc, Vec3 normal) {
+    bool resort = si->valid && si->n == rc->n &&
+                  1.5 * (double)si->n * v3_magnitude(v3_sub(normal, si->normal)) <= SLAB_RESORT_SHIFT;
+
+    if (!resort) {
+        if (!slab_index_reserve(si, tables, rc->n)) { return false; }
+        si->n = rc->n;
+        for (size_t i = 0; i < si->n; i++) {
+            si->entries[i].slot = (int)i;
+            si->q.x[i] = rc->q[i].x;
+            si->q.y[i] = rc->q[i].y;
+            si->q.z[i] = rc->q[i].z;
+        }
+    }
+
+    double key[RELP_CHUNK];
+    for (size_t i = 0; i < si->n; i += RELP_CHUNK) {
+        size_t m = si->n - i < RELP_CHUNK ? si->n - i : RELP_CHUNK;
+        v3_soa_dot_v3(v3_soa_offset(si->q, i), normal, m, key);
+        for (size_t r = 0; r < m; r++) { si->entries[i + r].key = key[r]; }
+    }
+
+    if (resort) {
+        for (size_t i = 1; i < si->n; i++) {
+            SlabEntry e = si->entries[i];
+            double x = si->q.x[i], y = si->q.y[i], z = si->q.z[i];
+            size_t j = i;
+            while (j > 0 && si->entries[j - 1].key > e.key) {
+                si->entries[j] = si->entries[j - 1];
+                si->q.x[j] = si->q.x[j - 1];
+                si->q.y[j] = si->q.y[j - 1];
+                si->q.z[j] = si->q.z[j - 1];
+                j--;
+            }
+            si->entries[j] = e;
+            si->q.x[j] = x;
+            si->q.y[j] = y;
+            si->q.z[j] = z;
+        }
+    }
+    else {
+        qsort(si->entries, si->n, sizeof(*si->entries), slab_entry_cmp);
+        for (size_t i = 0; i < si->n; i++) {
+            Vec3 q = rc->q[si->entries[i].slot];
+            si->q.x[i] = q.x;
+            si->q.y[i] = q.y;
+            si->q.z[i] = q.z;
+        }
+    }
+
+    si->normal = normal;
+    si->q_max = limiting_radius(rc->wavelength);
+    si->valid = true;
+    return true;
+}
+
+
+// First index entry with key >= x (binary search)
+static size_t slab_lower_bound(const SlabIndex *si, double x) {
+    size_t lo = 0, hi = si->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (si->entries[mid].key < x) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo;
+}
+
+
+// Fill crystal->space with the cached reflections within thickness/2 of the plane normal to frame column 2,
+//  projected onto frame columns 0 and 1 (a continuous viewing direction, not restricted to rational zones)
+//  |q.n - q.n0| <= |n - n0| * q_max bounds the error of the index keyed for n0, so a widened key range is
+//  found by binary search and filtered exactly: O(log n + k) per query. The index is re-keyed for the
+//  current normal once the widening exceeds the slab thickness
+bool generate_slab(Crystal *crystal, Mat3 frame, double thickness) {
+    if (!crystal || !crystal->cache || !crystal->slab || !crystal->space) { return false; }
+
+    const ReflectionCache *rc = crystal->cache;
+    SlabIndex *si = crystal->slab;
+    if (!rc->valid || thickness <= 0) { return false; }
+
+    Vec3 e1 = mat3_col(frame, 0);
+    Vec3 e2 = mat3_col(frame, 1);
+    Vec3 normal = v3_normalize(mat3_col(frame, 2));
+    double half = 0.5 * thickness;
+
+    // The slab is symmetric, so an index keyed for -n serves n equally well
+    double drift = INFINITY;
+    if (si->valid && si->n == rc->n) {
+        drift = si->q_max * fmin(v3_magnitude(v3_sub(normal, si->normal)), v3_magnitude(v3_add(normal, si->normal)));
+    }
+    if (drift > thickness) {
+        if (!slab_index_build(si, &crystal->tables, rc, normal)) { return false; }
+        drift = 0;
+    }
+
+    ReciprocalSpace *rs = crystal->space;
+    if (!rs_clear(rs, rs->zone)) { return false; }
+    if (!rs_begin_layer(rs, 0)) { return false; }
+
+    // Candidates are contiguous in the index, so their exact heights and projections come in batches
+    double height[RELP_CHUNK], u[RELP_CHUNK], v[RELP_CHUNK];
+    size_t end = slab_lower_bound(si, nextafter(half + drift, INFINITY));
+    for (size_t i = slab_lower_bound(si, -half - drift); i < end; i += RELP_CHUNK) {
+        size_t m = end - i < RELP_CHUNK ? end - i : RELP_CHUNK;
+        Vec3SoA q = v3_soa_offset(si->q, i);
+        v3_soa_dot_v3(q, normal, m, height);
+        v3_soa_dot_v3(q, e1, m, u);
+        v3_soa_dot_v3(q, e2, m, v);
+
+        for (size_t r = 0; r < m; r++) {
+            if (fabs(height[r]) > half) { continue; }
+
+            int slot = si->entries[i + r].slot;
+            ReciprocalPoint pt = {
+                .hkl = rc->hkl[slot],
+                .u = (RelpReal)u[r],
+                .v = (RelpReal)v[r],
+                .intensity = (RelpReal)rc->intensity[slot]
+            };
+            if (!rs_push(rs, pt)) { return false; }
+        }
+    }
+
+    // The space no longer holds the zone projection
+    crystal->pipeline.done &= ~STAGE_PROJECTION;
+
+    return rs_end_layer(rs);
+}
+
 
-    double a = crystal->lattice.a;
-    double b = crystal->lattice.b;
-    double c = crystal->lattice.c;
-    double alpha = crystal->lattice.alpha;
-    double beta = crystal->lattice.beta;
-    double gamma = crystal->lattice.gamma;
+// Check that a centering type exists for a crystal system (Bravais lattice)
+bool basis_valid(System sys, BasisType bas) {
+    switch(sys) {
+        case CUBIC:
+            return bas == PRIMITIVE || bas == BODY_CENTERED || bas == FACE_CENTERED;
+        case TETRAGONAL:
+            return bas == PRIMITIVE || bas == BODY_CENTERED;
+        case ORTHORHOMBIC:
+            return bas == PRIMITIVE || bas == BODY_CENTERED || bas == FACE_CENTERED || bas == BASE_CENTERED;
+        case MONOCLINIC:
+            return bas == PRIMITIVE || bas == BASE_CENTERED;
+        case HEXAGONAL:
+        case RHOMBOHEDRAL:
+        case TRICLINIC:
+            return bas == PRIMITIVE;
+        default: return false;
+    }
+}
+
+
+// Check that a space group fits a crystal system and centering type (0 = no space group, always fits)
+//  The R groups belong to the rhombohedral system (rhombohedral axes); A-centred groups have no basis here
+bool space_group_valid(System sys, BasisType bas, int number) {
+    if (number == 0) { return true; }
+
+    int lo, hi;
+    switch (sys) {
+        case TRICLINIC:    lo = 1;   hi = 2;   break;
+        case MONOCLINIC:   lo = 3;   hi = 15;  break;
+        case ORTHORHOMBIC: lo = 16;  hi = 74;  break;
+        case TETRAGONAL:   lo = 75;  hi = 142; break;
+        case HEXAGONAL:
+        case RHOMBOHEDRAL: lo = 143; hi = 194; break;
+        case CUBIC:        lo = 195; hi = 230; break;
+        default: return false;
+    }
+    if (number < lo || number > hi) { return false; }
+
+    char centring = sg_centring(number);
+    if (sys == RHOMBOHEDRAL) { return centring == 'R' && bas == PRIMITIVE; }
+
+    switch (bas) {
+        case PRIMITIVE:     return centring == 'P';
+        case BODY_CENTERED: return centring == 'I';
+        case FACE_CENTERED: return centring == 'F';
+        case BASE_CENTERED: return centring == 'C';
+        default: return false;
+    }
+}
+
+
+// Select the space group whose systematic absences are removed from the reflections (0 = none)
+//  Its reflection conditions are compiled here, once; the hkl stage re-runs on the next crystal_update
+bool crystal_set_space_group(Crystal *crystal, int number) {
+    if (!crystal || !crystal->basis || !crystal->group) { return false; }
+    if (!space_group_valid(crystal->lattice.type, crystal->basis->type, number)) { return false; }
+
+    if (crystal->group->number == number && number != 0) { return true; }
+    return sg_load(crystal->group, number, crystal->lattice.type == RHOMBOHEDRAL);
+}
+
+
+// Conventional cell matrix A from the lattice parameters (depends only on system and a,b,c,alpha,beta,gamma)
+bool cell_matrix(Lattice *lattice, System sys) {
+    if (!lattice) return false;
+
+    double a = lattice->a;
+    double b = lattice->b;
+    double c = lattice->c;
+    double alpha = lattice->alpha;
+    double beta = lattice->beta;
+    double gamma = lattice->gamma;
 
     switch(sys) {
         case CUBIC: 
-            switch(bas) {
-                case PRIMITIVE:
-                case BODY_CENTERED:
-                case FACE_CENTERED:
-                    crystal->lattice.A = (Mat3){ 
-                        .M = {
-                                { a,    0,    0 },
-                                { 0,    a,    0 },
-                                { 0,    0,    a }
-                    }};
-                    break;
-                default: return false;
-            }
+            lattice->A = (Mat3){ 
+                .M = {
+                        { a,    0,    0 },
+                        { 0,    a,    0 },
+                        { 0,    0,    a }
+            }};
             break;
         case TETRAGONAL:
-            switch(bas) {
-                case PRIMITIVE:
-                case BODY_CENTERED:
-                    crystal->lattice.A = (Mat3){ 
-                        .M = {
-                                { a,    0,    0 },
-                                { 0,    a,    0 },
-                                { 0,    0,    c }
-                    }};
-                    break;
-                default: return false;
-            }
+            lattice->A = (Mat3){ 
+                .M = {
+                        { a,    0,    0 },
+                        { 0,    a,    0 },
+                        { 0,    0,    c }
+            }};
             break;
         case HEXAGONAL:
-            switch(bas) {
-                case PRIMITIVE:
-                    crystal->lattice.A = (Mat3){ 
-                        .M = {
-                            { a,    -a / 2,           0 },
-                            { 0,    sqrt(3) * a / 2,  0 },  
-                            { 0,    0,                c }
-                        }
-                    };
-                    break;
-                default: return false;
-            }
+            lattice->A = (Mat3){ 
+                .M = {
+                    { a,    -a / 2,           0 },
+                    { 0,    sqrt(3) * a / 2,  0 },  
+                    { 0,    0,                c }
+                }
+            };
             break;
         case ORTHORHOMBIC:
-            switch(bas) {
-                case PRIMITIVE:
-                case BODY_CENTERED:
-                case FACE_CENTERED:
-                case BASE_CENTERED:
-                    crystal->lattice.A = (Mat3){ 
-                        .M = {
-                                { a,    0,    0 },
-                                { 0,    b,    0 },
-                                { 0,    0,    c }
-                    }};
-                    break;
-                default: return false;
-            }
+            lattice->A = (Mat3){ 
+                .M = {
+                        { a,    0,    0 },
+                        { 0,    b,    0 },
+                        { 0,    0,    c }
+            }};
             break;
         case MONOCLINIC:
-            switch(bas) {
-                case PRIMITIVE:
-                case BASE_CENTERED:
-                    crystal->lattice.A = (Mat3){ 
-                        .M = {
-                                { a,    0,    c * cos((DEG2RAD * beta)) },
-                                { 0,    b,                            0 },
-                                { 0,    0,    c * sin((DEG2RAD * beta)) }
-                    }};
-                    break;
-                default: return false;
-            }
+            lattice->A = (Mat3){ 
+                .M = {
+                        { a,    0,    c * cos((DEG2RAD * beta)) },
+                        { 0,    b,                            0 },
+                        { 0,    0,    c * sin((DEG2RAD * beta)) }
+            }};
             break;
         case TRICLINIC:
         case RHOMBOHEDRAL: {
-            switch(bas) {
-                case PRIMITIVE:
-                    double c_x = c * cos((DEG2RAD * beta));
-                    double c_y = c * (cos((DEG2RAD * alpha)) - cos((DEG2RAD * beta)) * cos((DEG2RAD * gamma))) / sin((DEG2RAD * gamma));
-                    double c_z = sqrt(c * c - c_x * c_x - c_y * c_y);
-                    crystal->lattice.A = (Mat3){ 
-                        .M = {
-                                { a,    b * cos((DEG2RAD * gamma)),    c_x},
-                                { 0,    b * sin((DEG2RAD * gamma)),    c_y},
-                                { 0,    0,                             c_z}
-                    }};
-                    break;
-                default: return false;
-            }
+            double c_x = c * cos((DEG2RAD * beta));
+            double c_y = c * (cos((DEG2RAD * alpha)) - cos((DEG2RAD * beta)) * cos((DEG2RAD * gamma))) / sin((DEG2RAD * gamma));
+            double c_z = sqrt(c * c - c_x * c_x - c_y * c_y);
+            lattice->A = (Mat3){ 
+                .M = {
+                        { a,    b * cos((DEG2RAD * gamma)),    c_x},
+                        { 0,    b * sin((DEG2RAD * gamma)),    c_y},
+                        { 0,    0,                             c_z}
+            }};
             break;
         }
         default: return false;
     }
+
+    lattice->type = sys;
+    return true;
+}
+
+
+// Fractional positions of the basis atoms for a centering type, all of element basis->element
+//  (depends only on system, basis type and element)
+bool basis_positions(BasisAtoms *basis, System sys, BasisType bas) {
+    if (!basis || !basis_valid(sys, bas)) return false;
+
     switch(bas) {
         case PRIMITIVE:
             if (sys == RHOMBOHEDRAL) {
-                if (!basis_atoms_resize(3, crystal->basis)) { return false; }
-                crystal->basis->pos[0] = (Vec3){0.0, 0.0, 0.0};
-                crystal->basis->pos[1] = (Vec3){2.0/3.0, 1.0/3.0, 1.0/3.0};
-                crystal->basis->pos[2] = (Vec3){1.0/3.0, 2.0/3.0, 2.0/3.0};
+                if (!basis_atoms_resize(3, basis)) { return false; }
+                basis->pos[0] = (Vec3){0.0, 0.0, 0.0};
+                basis->pos[1] = (Vec3){2.0/3.0, 1.0/3.0, 1.0/3.0};
+                basis->pos[2] = (Vec3){1.0/3.0, 2.0/3.0, 2.0/3.0};
+                basis->form = SF_FORM_RHOMBO;
                 break;
             }
-            if (!basis_atoms_resize(1, crystal->basis)) { return false; }
-            crystal->basis->pos[0] = (Vec3){0, 0, 0};
+            if (!basis_atoms_resize(1, basis)) { return false; }
+            basis->pos[0] = (Vec3){0, 0, 0};
+            basis->form = SF_FORM_PRIMITIVE;
             break;
         case BODY_CENTERED:
-            if (!basis_atoms_resize(2, crystal->basis)) { return false; }
-            crystal->basis->pos[0] = (Vec3){0, 0, 0};
-            crystal->basis->pos[1] = (Vec3){0.5, 0.5, 0.5};
+            if (!basis_atoms_resize(2, basis)) { return false; }
+            basis->pos[0] = (Vec3){0, 0, 0};
+            basis->pos[1] = (Vec3){0.5, 0.5, 0.5};
+            basis->form = SF_FORM_BODY;
             break;
         case FACE_CENTERED:
-            if (!basis_atoms_resize(4, crystal->basis)) { return false; }
-            crystal->basis->pos[0] = (Vec3){0, 0, 0};
-            crystal->basis->pos[1] = (Vec3){0.5, 0.5, 0};
-            crystal->basis->pos[2] = (Vec3){0.5, 0, 0.5};
-            crystal->basis->pos[3] = (Vec3){0, 0.5, 0.5};
+            if (!basis_atoms_resize(4, basis)) { return false; }
+            basis->pos[0] = (Vec3){0, 0, 0};
+            basis->pos[1] = (Vec3){0.5, 0.5, 0};
+            basis->pos[2] = (Vec3){0.5, 0, 0.5};
+            basis->pos[3] = (Vec3){0, 0.5, 0.5};
+            basis->form = SF_FORM_FACE;
             break;
         case BASE_CENTERED:
-            if (!basis_atoms_resize(2, crystal->basis)) { return false; }
-            crystal->basis->pos[0] = (Vec3){0, 0, 0};
-            crystal->basis->pos[1] = (Vec3){0.5, 0.5, 0};
+            if (!basis_atoms_resize(2, basis)) { return false; }
+            basis->pos[0] = (Vec3){0, 0, 0};
+            basis->pos[1] = (Vec3){0.5, 0.5, 0};
+            basis->form = SF_FORM_BASE;
             break;
         default: return false;
     }
 
-    crystal->lattice.a = a; crystal->lattice.b = b; crystal->lattice.c = c;
-    crystal->lattice.alpha = alpha; crystal->lattice.beta = beta; crystal->lattice.gamma = gamma;
-    crystal->lattice.type = sys;
-    crystal->basis->type = bas;
+    for (size_t i = 0; i < basis->n; i++) {
+        basis->Z[i] = basis->element;
+        basis->Biso[i] = basis->b_iso;
+        basis->U[i] = (Mat3){0};
+    }
 
+    basis->type = bas;
     return true;
 }
 
 
-bool generate_space(Crystal *crystal, System sys, BasisType bas, HKL zone) {
-    if (!crystal || !crystal->basis || !crystal->space) return false;
+bool generate_cell(Crystal *crystal, System sys, BasisType bas) {
+    if (!crystal || !crystal->basis) return false;
 
-    crystal->lattice.type = sys;
-    crystal->basis->type = bas;
+    if (!basis_valid(sys, bas)) return false;
+    if (!cell_matrix(&crystal->lattice, sys)) return false;
+    if (!basis_positions(crystal->basis, sys, bas)) return false;
+
+    return true;
+}
+
+
+// PIPELINE ----------------------- //
+
+// Stages that must re-run when a stage runs (direct dependents only)
+static const unsigned STAGE_DEPENDENTS[STAGE_COUNT] = {
+    [0] = STAGE_RECIPROCAL,     // STAGE_CELL
+    [1] = STAGE_SF,             // STAGE_ATOMS
+    [2] = STAGE_HKL,            // STAGE_RECIPROCAL
+    [3] = STAGE_SF,             // STAGE_HKL
+    [4] = STAGE_PROJECTION,     // STAGE_SF
+    [5] = 0,                    // STAGE_PROJECTION
+};
+
+
+static const char *STAGE_NAMES[STAGE_COUNT] = {
+    "cell", "atoms", "reciprocal", "hkl", "structure factors", "projection"
+};
+
+
+const char *stage_name(int stage) {
+    if (stage < 0 || stage >= STAGE_COUNT) { return "unknown"; }
+    return STAGE_NAMES[stage];
+}
+
+
+static const char *ARENA_NAMES[CRYSTAL_ARENA_COUNT] = {
+    "parts", "basis", "tables", "space"
+};
+
+
+const char *crystal_arena_name(CrystalArena which) {
+    if (which < 0 || which >= CRYSTAL_ARENA_COUNT) { return "unknown"; }
+    return ARENA_NAMES[which];
+}
+
+
+// Allocation counters of one of a crystal's arenas into *stats; false if it has no such arena
+bool crystal_arena_stats(const Crystal *crystal, CrystalArena which, ArenaStats *stats) {
+    if (!crystal || !stats) { return false; }
+
+    const Arena *arena;
+    switch (which) {
+        case CRYSTAL_ARENA_PARTS:  arena = &crystal->arena; break;
+        case CRYSTAL_ARENA_BASIS:  arena = crystal->basis ? &crystal->basis->arena : NULL; break;
+        case CRYSTAL_ARENA_TABLES: arena = &crystal->tables; break;
+        case CRYSTAL_ARENA_SPACE:  arena = crystal->space ? &crystal->space->arena : NULL; break;
+        default:                   arena = NULL; break;
+    }
+    if (!arena) { return false; }
+
+    *stats = (ArenaStats){
+        .allocations = arena->allocations,
+        .resets = arena->resets,
+        .used = arena->used,
+        .high_water = arena->high_water,
+        .reserved = arena->reserved
+    };
+    return true;
+}
+
+
+// Force stages (and everything downstream of them) to re-run on the next crystal_update
+void crystal_invalidate(Crystal *crystal, unsigned stages) {
+    if (!crystal) { return; }
+    crystal->pipeline.done &= ~stages;
+}
+
+
+// Re-run only the stages whose inputs differ from the ones they last ran with, plus their dependents
+//  Inputs: cell    <- system, a, b, c, alpha, beta, gamma
+//          atoms   <- system, basis type, element
+//          hkl     <- reciprocal basis, wavelength, space group
+//          projection <- zone
+//  The stages executed (and their wall time) are recorded in crystal->pipeline for profiling
+bool crystal_update(Crystal *crystal, HKL zone, double wavelength) {
+    if (!crystal || !crystal->basis || !crystal->space || !crystal->cache || !crystal->group) return false;
+
+    Pipeline *pl = &crystal->pipeline;
+    const Lattice *lat = &crystal->lattice;
+    System sys = lat->type;
+    BasisType bas = crystal->basis->type;
+
+    pl->ran = 0;
+    if (!basis_valid(sys, bas)) return false;
+    if (!space_group_valid(sys, bas, crystal->group->number)) return false;
+
+    unsigned dirty = ~pl->done & STAGE_ALL;
+    if (pl->system != sys || pl->a != lat->a || pl->b != lat->b || pl->c != lat->c ||
+        pl->alpha != lat->alpha || pl->beta != lat->beta || pl->gamma != lat->gamma) {
+        dirty |= STAGE_CELL;
+    }
+    if (pl->system != sys || pl->basis_type != bas || pl->element != crystal->basis->element || pl->b_iso != crystal->basis->b_iso) {
+        dirty |= STAGE_ATOMS;
+    }
+    if (pl->anomalous != crystal->basis->anomalous) { dirty |= STAGE_SF; }
+    if (pl->wavelength != wavelength || pl->space_group != crystal->group->number) { dirty |= STAGE_HKL; }
+    if (pl->zone.h != zone.h || pl->zone.k != zone.k || pl->zone.l != zone.l) { dirty |= STAGE_PROJECTION; }
+
+    // Propagate downstream (stages are numbered in topological order)
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        if (dirty & (1u << i)) { dirty |= STAGE_DEPENDENTS[i]; }
+    }
 
-    if (!generate_cell(crystal, sys, bas)) return false;
-    if (!rs_basis(crystal)) return false;
-    if (!generate_relp(crystal, zone)) return false;
-    
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        if (!(dirty & (1u << i))) { pl->stage_ms[i] = 0; continue; }
+
+        // Outputs of this stage and everything after it are stale until they run again
+        pl->done &= ~(dirty & ~((1u << i) - 1));
+
+        double t0 = now_ms();
+        bool ok;
+        switch (1u << i) {
+            case STAGE_CELL:       ok = cell_matrix(&crystal->lattice, sys); break;
+            case STAGE_ATOMS:      ok = basis_positions(crystal->basis, sys, bas); break;
+            case STAGE_RECIPROCAL: ok = rs_basis(crystal); break;
+            case STAGE_HKL:        ok = rc_build(crystal, wavelength); break;
+            case STAGE_SF:         ok = rc_structure_factors(crystal); break;
+            case STAGE_PROJECTION: ok = generate_relp(crystal, zone, wavelength); break;
+            default:               ok = false; break;
+        }
+        pl->stage_ms[i] = now_ms() - t0;
+        if (!ok) { return false; }
+
+        pl->ran |= 1u << i;
+        pl->done |= 1u << i;
+    }
+
+    pl->system = sys;
+    pl->a = lat->a; pl->b = lat->b; pl->c = lat->c;
+    pl->alpha = lat->alpha; pl->beta = lat->beta; pl->gamma = lat->gamma;
+    pl->basis_type = bas;
+    pl->element = crystal->basis->element;
+    pl->b_iso = crystal->basis->b_iso;
+    pl->anomalous = crystal->basis->anomalous;
+    pl->space_group = crystal->group->number;
+    pl->wavelength = wavelength;
+    pl->zone = zone;
     crystal->space->zone = zone;
 
     return true;
 }
 
 
+bool generate_space(Crystal *crystal, System sys, BasisType bas, HKL zone, double wavelength) {
+    if (!crystal || !crystal->basis || !crystal->space) return false;
+
+    crystal->lattice.type = sys;
+    crystal->basis->type = bas;
+
+    return crystal_update(crystal, zone, wavelength);
+}
+
+
 bool validate_lat_params(System type, double a, double b, double c, double alpha, double beta, double gamma) {
     switch (type) {
         case CUBIC:
@@ -3,11 +3,29 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "math_helper.h"   
+#include "spacegroup.h"
+#include "formfactor.h"
+#include "arena.h"
 
 typedef enum { CUBIC, TETRAGONAL, HEXAGONAL, ORTHORHOMBIC, RHOMBOHEDRAL, MONOCLINIC, TRICLINIC } System;
 typedef enum { PRIMITIVE, BODY_CENTERED, FACE_CENTERED, BASE_CENTERED} BasisType;
 
+#define CU_KA1 1.540562   // Cu K-alpha 1 wavelength (Angstrom), default incoming radiation
+#define RELP_CHUNK 256    // reflections handed to a stream consumer per call
+#define SLAB_RESORT_SHIFT 16.0  // entries a re-keyed slab entry may pass before the index is sorted afresh instead
+#define SF_MEMO_BASES 8   // basis fingerprints a structure-factor memo remembers having stored
+
+// Precision of reflection points: the ReciprocalSpace arrays, streamed points (ReciprocalPoint), the u/v row
+//  stepping of stream_layer and draw_reflection; -DRELP_FLOAT32 makes them float, halving what the render loop
+//  streams. Lattice construction, the reflection cache and structure factors stay double
+#if defined(RELP_FLOAT32)
+typedef float RelpReal;
+#else
+typedef double RelpReal;
+#endif
+
 
 // STRUCTS ------------------------ //
 
@@ -20,35 +38,210 @@ typedef struct {
 } Lattice;
 
 
+// Basis atoms packed for the structure-factor engine: one 64-byte aligned array per coordinate
+//  Atoms are grouped by element, each group but the last padded to a whole cache line with f = 0
+typedef struct {
+    size_t n;           // slots in use, padding between element groups included
+    size_t cap;
+    double *x, *y, *z;  // fractional positions
+    double *f;          // 1 for an atom, 0 for padding (scaled by the element's f(s) per reflection)
+    double *w11, *w22, *w33, *w12, *w13, *w23;  // Debye-Waller exponent h^T W h of each slot (symmetric W)
+    bool thermal;       // some slot has W != 0
+    size_t n_groups;    // one group per form-factor table (a single one without tables)
+    size_t group[FF_MAX_ELEMENTS + 1];  // slots [group[e], group[e+1]) hold the atoms of table e
+    const FFTables *ff;
+} SFAtoms;
+
+
+// Structure factor of a basis: closed form for the built-in cells (times |f(s) T|^2 of their single element and displacement),
+//  the full sum for anything else
+typedef enum {
+    SF_FORM_GENERIC,    // sum over atoms (user-supplied or edited positions)
+    SF_FORM_PRIMITIVE,  // 1 atom: |F|^2 = 1
+    SF_FORM_BODY,       // h+k+l even: 4
+    SF_FORM_FACE,       // h,k,l unmixed: 16
+    SF_FORM_BASE,       // h+k even: 4
+    SF_FORM_RHOMBO      // -h+k+l = 3n: 9 (3-atom rhombohedral basis, hexagonal axes)
+} SFForm;
+
+
 typedef struct {
     size_t n;
     Vec3 *pos;   // atomic positions (fractional unit cell) 
-    int *Z;
+    int *Z;      // atomic number of each atom (0 = unit point scatterer)
+    double *Biso;   // isotropic displacement B = 8PI^2 <u^2> of each atom (Angstrom^2, 0 = at rest)
+    Mat3 *U;        // anisotropic displacement Uij of each atom on the reciprocal axes (Angstrom^2, CIF convention), adds to Biso
     BasisType type;
+    int element; // Z given to every atom of the built-in bases
+    double b_iso;   // Biso given to every atom of the built-in bases
+    bool anomalous; // add f' + i f'' of the radiation, so F(hkl) and F(-h-k-l) can differ
+    SFForm form; // set by basis_positions; reset to SF_FORM_GENERIC after editing pos, Z, Biso or U
+    SFAtoms soa; // copy of pos/f/displacements in SoA layout, repacked by rc_structure_factors
+    FFTables ff; // form factors of the elements in Z (and their dispersion), refreshed by rc_structure_factors
+    Arena arena; // pos, Z, Biso and U, rewound and carved again by every resize
 } BasisAtoms;
 
 
 typedef struct {
     HKL hkl;
-    double u, v; 
-    double intensity; 
+    RelpReal u, v; 
+    RelpReal intensity; 
 } ReciprocalPoint;
 
 
+// Contiguous block of points belonging to one Laue zone layer h*u + k*v + l*w = order
+typedef struct {
+    int order;      // 0 = ZOLZ, +-1 = FOLZ, +-2 = SOLZ, ...
+    size_t offset;  // index of the layer's first point
+    size_t n;
+} RSLayer;
+
+
+// Miller indices of a stored point, only read to label it
+typedef struct {
+    int16_t h, k, l;
+} RelpLabel;
+
+
+// Stored points split by access: the render loop streams u, v and intensity (3 RelpReal a point) every frame
+//  and reads the labels (6 bytes) only for the points it draws
 typedef struct {
     size_t n;
-    ReciprocalPoint *pts; 
+    size_t cap; // allocated length of the point arrays, only ever grows
+    RelpReal *u, *v;        // projected coordinates (1/Angstrom)
+    RelpReal *intensity;    // |F|^2
+    RelpLabel *hkl;
     HKL zone; // The normal vector of our plane which slices through the 3D reciprocal space    
+
+    size_t n_layers;
+    size_t layers_cap;
+    RSLayer *layers;    // layers in generation order (0, 1, -1, 2, -2, ...)
+
+    Arena arena;    // point arrays and layers of the current generation, rewound by rs_clear
 } ReciprocalSpace;
 
 
+// Every reflection inside the limiting sphere, kept between zone changes (SoA layout)
+typedef struct {
+    size_t n;
+    size_t cap;
+    HKL *hkl;
+    Vec3 *q;            // scattering vector h*a* + k*b* + l*c*
+    double *intensity;  // |F|^2
+    int *multiplicity;  // cached reflections in each Laue orbit (equal |F|^2 throughout), on the orbit's first slot from 000 on, 0 elsewhere
+
+    int hmax, kmax, lmax;   // index box enclosing the sphere
+    int *index;             // box cell -> slot in the arrays above, -1 outside the sphere
+
+    bool valid;         // hkl set and |F|^2 are both current
+    double wavelength;
+    size_t sf_summed;   // reflections the last |F|^2 pass summed over the atoms (closed forms, the FFT grid and memo hits add none)
+} ReflectionCache;
+
+
+// Cached reflections ordered by their projection on a reference normal, for slab queries
+typedef struct {
+    double key;     // q . normal
+    int slot;       // reflection slot in the cache
+} SlabEntry;
+
+
+typedef struct {
+    size_t n;
+    size_t cap;
+    SlabEntry *entries; // ascending key
+    Vec3SoA q;          // q of each entry, in the same order, for the batch kernels
+    Vec3 normal;        // unit normal the keys were computed for
+    double q_max;       // |q| bound of the cache, limits how far keys drift when the normal tilts
+    bool valid;
+} SlabIndex;
+
+
+// |F|^2 of one reflection for one basis fingerprint (SFMemo)
+typedef struct {
+    uint64_t basis;     // fingerprint of the atoms, lattice and radiation, 0 = empty slot
+    int h, k, l;
+    uint32_t used;      // memo clock at the last lookup or store, the oldest is evicted first
+    double intensity;
+} SFMemoEntry;
+
+
+// Bounded open-addressing table of earlier |F|^2, so a basis and lattice that come back (a rollback, a toggle
+//  between two cells or radiations) skip the structure-factor sum for every reflection already seen
+typedef struct {
+    size_t cap;             // slots, a power of two (0 until first used)
+    SFMemoEntry *entries;
+    uint32_t clock;         // advanced once per structure-factor pass
+    size_t hits, misses;    // lookups since the crystal was created
+    size_t evictions;
+    uint64_t bases[SF_MEMO_BASES];  // fingerprints stored since the table last started over (0 = none)
+    size_t next_base;               // the one the next new fingerprint replaces
+} SFMemo;
+
+
+// Regeneration stages, numbered in dependency order:
+//  cell -> reciprocal -> hkl -> structure factors -> projection, atoms -> structure factors
+typedef enum {
+    STAGE_CELL       = 1 << 0,  // conventional cell matrix A
+    STAGE_ATOMS      = 1 << 1,  // basis atom positions
+    STAGE_RECIPROCAL = 1 << 2,  // reciprocal basis B
+    STAGE_HKL        = 1 << 3,  // reflections inside the limiting sphere (less space-group absences) and their q vectors
+    STAGE_SF         = 1 << 4,  // |F|^2 of every cached reflection
+    STAGE_PROJECTION = 1 << 5,  // 2D points of the chosen zone
+    STAGE_ALL        = (1 << 6) - 1
+} Stage;
+
+#define STAGE_COUNT 6
+
+
+// The arenas of a crystal, by lifetime
+typedef enum {
+    CRYSTAL_ARENA_PARTS,    // the part structs and the memo table, as long as the crystal
+    CRYSTAL_ARENA_BASIS,    // basis atom arrays, per resize
+    CRYSTAL_ARENA_TABLES,   // reflection cache and slab index, per hkl set
+    CRYSTAL_ARENA_SPACE,    // projected points and layers, per generation
+    CRYSTAL_ARENA_COUNT
+} CrystalArena;
+
+
+// Inputs each stage last ran with, and which stages have current outputs
+typedef struct {
+    unsigned done;              // stages whose outputs are current
+    unsigned ran;               // stages executed by the last crystal_update
+    double stage_ms[STAGE_COUNT];
+
+    System system;
+    double a, b, c;
+    double alpha, beta, gamma;
+    BasisType basis_type;
+    int element;
+    double b_iso;
+    bool anomalous;
+    int space_group;
+    double wavelength;
+    HKL zone;
+} Pipeline;
+
+
 typedef struct {
     Lattice lattice;
     BasisAtoms *basis;
     ReciprocalSpace *space;
+    ReflectionCache *cache;
+    SlabIndex *slab;
+    SFMemo *memo;
+    SpaceGroup *group;  // systematic absences on top of the basis (number 0 = none)
+    Pipeline pipeline;
+    Arena arena;        // the parts above and the memo table, released together by crystal_free
+    Arena tables;       // cache arrays, index box and slab index of the current hkl set, rewound by rc_build
 } Crystal;
 
 
+// Consumer of streamed reflections: called with consecutive chunks of at most RELP_CHUNK points
+//  (the buffer is reused once it returns); returning false stops generation
+typedef bool (*RelpConsumer)(void *user, const ReciprocalPoint *pts, size_t n);
+
+
 
 void basis_atoms_destroy(BasisAtoms *bas);
 
@@ -59,28 +252,106 @@ bool basis_atoms_resize(size_t n, BasisAtoms *bas);
 void rs_destroy(ReciprocalSpace *rs);
 
 
+bool rs_reserve(ReciprocalSpace *rs, size_t n);
+
+
 bool rs_resize(ReciprocalSpace *rs, size_t n, HKL zone);
 
 
+bool rs_clear(ReciprocalSpace *rs, HKL zone);
+
+
+bool rs_begin_layer(ReciprocalSpace *rs, int order);
+
+
+bool rs_end_layer(ReciprocalSpace *rs);
+
+
+bool rs_keep_layers(ReciprocalSpace *rs, size_t count);
+
+
+bool rs_push(ReciprocalSpace *rs, ReciprocalPoint pt);
+
+
+bool rc_build(Crystal *crystal, double wavelength);
+
+
+bool rc_structure_factors(Crystal *crystal);
+
+
+long rc_find(const ReflectionCache *rc, HKL plane);
+
+
 void crystal_free(Crystal *crystal);
 
 
 Crystal* crystal_init(double a, double b, double c, double alpha, double beta, double gamma);
 
 
+bool crystal_arena_stats(const Crystal *crystal, CrystalArena which, ArenaStats *stats);
+
+
+const char *crystal_arena_name(CrystalArena which);
+
+
 bool rs_basis(Crystal *crystal);
 
 
+double limiting_radius(double wavelength);
+
+
 double structure_factor(Crystal *crystal, HKL plane);
 
 
-bool generate_relp(Crystal *crystal, HKL zone);
+Mat3 zone_frame(const Lattice *lattice, HKL zone);
+
+
+bool stream_layer(Crystal *crystal, HKL zone, int order, double wavelength, RelpConsumer consume, void *user);
+
+
+bool stream_relp(Crystal *crystal, HKL zone, double wavelength, RelpConsumer consume, void *user);
+
+
+bool generate_layer(Crystal *crystal, HKL zone, int order, double wavelength);
+
+
+bool generate_relp(Crystal *crystal, HKL zone, double wavelength);
+
+
+bool generate_next_layer(Crystal *crystal, double wavelength);
+
+
+bool generate_slab(Crystal *crystal, Mat3 frame, double thickness);
+
+
+bool basis_valid(System sys, BasisType bas);
+
+
+bool space_group_valid(System sys, BasisType bas, int number);
+
+
+bool crystal_set_space_group(Crystal *crystal, int number);
+
+
+bool cell_matrix(Lattice *lattice, System sys);
+
+
+bool basis_positions(BasisAtoms *basis, System sys, BasisType bas);
 
 
 bool generate_cell(Crystal *crystal, System sys, BasisType bas);
 
 
-bool generate_space(Crystal *crystal, System sys, BasisType bas, HKL zone);
+const char *stage_name(int stage);
+
+
+void crystal_invalidate(Crystal *crystal, unsigned stages);
+
+
+bool crystal_update(Crystal *crystal, HKL zone, double wavelength);
+
+
+bool generate_space(Crystal *crystal, System sys, BasisType bas, HKL zone, double wavelength);
 
 
 bool validate_lat_params(System type, double a, double b, double c, double alpha, double beta, double gamma);
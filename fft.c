@@ -0,0 +1,245 @@
+/****************************************************************************************
+ * fft.c
+ *
+ * Complex FFT for lengths 2^a 3^b 5^c (no external library)
+ *  - Stockham autosort: one pass per radix between two line buffers, so the result comes out
+ *    in natural order without a bit-reversal permutation and every pass reads contiguously
+ *  - Radices are taken 4 first, then 2, 3, 5; twiddles come from one table of N roots
+ *  - 3D transforms run the 1D one along every line of each axis (row-major grid)
+ *
+ ****************************************************************************************/
+
+
+#include "fft.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "math_helper.h"
+
+
+// METHODS ------------------------ //
+
+// Smallest length >= n whose only prime factors are 2, 3 and 5
+size_t fft_good_size(size_t n) {
+    if (n <= 1) { return 1; }
+
+    for (size_t m = n; ; m++) {
+        size_t r = m;
+        while (r % 2 == 0) { r /= 2; }
+        while (r % 3 == 0) { r /= 3; }
+        while (r % 5 == 0) { r /= 5; }
+        if (r == 1) { return m; }
+    }
+}
+
+
+// Factor n and tabulate its roots of unity; false if n has a prime factor above 5 or memory runs out
+bool fft_plan_init(FFTPlan *plan, size_t n, int sign) {
+    if (!plan || n == 0) { return false; }
+    *plan = (FFTPlan){0};
+
+    size_t r = n;
+    const size_t radices[] = { 4, 2, 3, 5 };
+    for (size_t i = 0; i < 4; i++) {
+        while (r % radices[i] == 0) {
+            if (plan->n_factors == FFT_MAX_FACTORS) { return false; }
+            plan->factor[plan->n_factors++] = radices[i];
+            r /= radices[i];
+        }
+    }
+    if (r != 1) { return false; }
+
+    plan->twiddle = malloc(n * sizeof(*plan->twiddle));
+    plan->scratch = malloc(2 * n * sizeof(*plan->scratch));
+    if (!plan->twiddle || !plan->scratch) {
+        fft_plan_free(plan);
+        return false;
+    }
+
+    for (size_t j = 0; j < n; j++) { plan->twiddle[j] = cexp(sign * 2 * PI * I * (double)j / (double)n); }
+    plan->n = n;
+    plan->sign = sign;
+
+    return true;
+}
+
+
+void fft_plan_free(FFTPlan *plan) {
+    if (!plan) { return; }
+
+    free(plan->twiddle);
+    free(plan->scratch);
+    *plan = (FFTPlan){0};
+
+    return;
+}
+
+
+// a * b without the C99 inf/nan recovery (a libgcc call per product otherwise)
+static inline double complex fft_mul(double complex a, double complex b) {
+    return CMPLX(creal(a) * creal(b) - cimag(a) * cimag(b), creal(a) * cimag(b) + cimag(a) * creal(b));
+}
+
+
+// i sign z
+static inline double complex fft_rotate(double complex z, double sign) {
+    return CMPLX(-sign * cimag(z), sign * creal(z));
+}
+
+
+// One Stockham pass of radix p over sub-transforms of length ns (ns p divides N): in -> out, self-sorting
+//  Output j of sub-transform b is out[b ns p + k + r ns] = sum_q w^(q r) W^(q k) in[b ns + k + q N/p], with
+//  j = k + r ns, W the length-(ns p) root and w = W^ns
+static void fft_pass(const FFTPlan *plan, size_t p, size_t ns, const double complex *in, double complex *out) {
+    size_t N = plan->n;
+    size_t span = N / p;                // distance between the p inputs of one butterfly
+    size_t tw_step = N / (ns * p);
+    const double complex *tw = plan->twiddle;
+    double sign = plan->sign;
+
+// Runs body once per butterfly with its twiddled inputs t[0 .. p) and outputs dst[k + r ns]
+#define FFT_BUTTERFLIES(...) do {                                                                               \
+        for (size_t b = 0; b < span / ns; b++) {                                                                \
+            const double complex *src = in + b * ns;                                                            \
+            double complex *dst = out + b * ns * p;                                                             \
+            for (size_t k = 0; k < ns; k++) {                                                                   \
+                double complex t[5];                                                                            \
+                t[0] = src[k];                                                                                  \
+                for (size_t q = 1; q < p; q++) { t[q] = fft_mul(tw[q * k * tw_step], src[k + q * span]); }      \
+                __VA_ARGS__                                                                                     \
+            }                                                                                                   \
+        }                                                                                                       \
+    } while (0)
+
+    switch (p) {
+        case 2:
+            FFT_BUTTERFLIES({
+                dst[k] = t[0] + t[1];
+                dst[k + ns] = t[0] - t[1];
+            });
+            break;
+
+        case 4:
+            // w = sign i
+            FFT_BUTTERFLIES({
+                double complex a0 = t[0] + t[2], a1 = t[0] - t[2], a2 = t[1] + t[3], a3 = fft_rotate(t[1] - t[3], sign);
+                dst[k] = a0 + a2;
+                dst[k + ns] = a1 + a3;
+                dst[k + 2 * ns] = a0 - a2;
+                dst[k + 3 * ns] = a1 - a3;
+            });
+            break;
+
+        case 3:
+            // w = cos(2PI/3) + sign i sin(2PI/3)
+            FFT_BUTTERFLIES({
+                double complex s12 = t[1] + t[2];
+                double complex mid = t[0] - 0.5 * s12;
+                double complex rot = fft_rotate(0.86602540378443864676 * (t[1] - t[2]), sign);
+                dst[k] = t[0] + s12;
+                dst[k + ns] = mid + rot;
+                dst[k + 2 * ns] = mid - rot;
+            });
+            break;
+
+        case 5:
+            // w^r + w^-r = 2 cos(2PI r/5), w^r - w^-r = 2 sign i sin(2PI r/5)
+            FFT_BUTTERFLIES({
+                const double c1 = 0.30901699437494742410, c2 = -0.80901699437494742410;
+                const double s1 = 0.95105651629515357212, s2 = 0.58778525229247312917;
+                double complex a1 = t[1] + t[4], b1 = t[1] - t[4], a2 = t[2] + t[3], b2 = t[2] - t[3];
+                double complex m1 = t[0] + c1 * a1 + c2 * a2, r1 = fft_rotate(s1 * b1 + s2 * b2, sign);
+                double complex m2 = t[0] + c2 * a1 + c1 * a2, r2 = fft_rotate(s2 * b1 - s1 * b2, sign);
+                dst[k] = t[0] + a1 + a2;
+                dst[k + ns] = m1 + r1;
+                dst[k + 2 * ns] = m2 + r2;
+                dst[k + 3 * ns] = m2 - r2;
+                dst[k + 4 * ns] = m1 - r1;
+            });
+            break;
+
+        default:
+            break;
+    }
+
+#undef FFT_BUTTERFLIES
+
+    return;
+}
+
+
+// In-place transform of data[0], data[stride], ..., data[(n - 1) stride]
+void fft_line(const FFTPlan *plan, double complex *data, size_t stride) {
+    if (!plan || !data || plan->n <= 1) { return; }
+
+    // Contiguous data is transformed where it is; strided data is gathered into the scratch line first
+    double complex *a = data, *b = plan->scratch;
+    if (stride != 1) {
+        a = plan->scratch;
+        b = plan->scratch + plan->n;
+        for (size_t j = 0; j < plan->n; j++) { a[j] = data[j * stride]; }
+    }
+
+    size_t ns = 1;
+    for (size_t f = 0; f < plan->n_factors; f++) {
+        fft_pass(plan, plan->factor[f], ns, a, b);
+        ns *= plan->factor[f];
+        double complex *t = a;
+        a = b;
+        b = t;
+    }
+
+    // The result sits in a; bring it back to data if that is not where it already is
+    if (a != data) {
+        for (size_t j = 0; j < plan->n; j++) { data[j * stride] = a[j]; }
+    }
+
+    return;
+}
+
+
+// Transform the lines data[j * stride + i], i < count (adjacent lines): gathered FFT_BLOCK at a time, so every
+//  row of the gather reads whole cache lines instead of one element per row
+static void fft_lines(const FFTPlan *plan, double complex *data, size_t stride, size_t count, double complex *block) {
+    size_t n = plan->n;
+
+    for (size_t i = 0; i < count; i += FFT_BLOCK) {
+        size_t width = count - i < FFT_BLOCK ? count - i : FFT_BLOCK;
+        if (!block) {
+            for (size_t c = 0; c < width; c++) { fft_line(plan, data + i + c, stride); }
+            continue;
+        }
+
+        for (size_t j = 0; j < n; j++) {
+            for (size_t c = 0; c < width; c++) { block[c * n + j] = data[j * stride + i + c]; }
+        }
+        for (size_t c = 0; c < width; c++) { fft_line(plan, block + c * n, 1); }
+        for (size_t j = 0; j < n; j++) {
+            for (size_t c = 0; c < width; c++) { data[j * stride + i + c] = block[c * n + j]; }
+        }
+    }
+
+    return;
+}
+
+
+// In-place 3D transform of a row-major grid[(i0 * n1 + i1) * n2 + i2], plan[a] of length n_a
+void fft_3d(const FFTPlan plan[3], double complex *grid) {
+    if (!plan || !grid) { return; }
+
+    size_t n0 = plan[0].n, n1 = plan[1].n, n2 = plan[2].n;
+
+    // Without the block buffer the strided axes go line by line
+    size_t longest = n0 > n1 ? n0 : n1;
+    double complex *block = malloc(FFT_BLOCK * longest * sizeof(*block));
+
+    for (size_t i0 = 0; i0 < n0; i0++) {
+        for (size_t i1 = 0; i1 < n1; i1++) { fft_line(&plan[2], grid + (i0 * n1 + i1) * n2, 1); }
+    }
+    for (size_t i0 = 0; i0 < n0; i0++) { fft_lines(&plan[1], grid + i0 * n1 * n2, n2, n2, block); }
+    fft_lines(&plan[0], grid, n1 * n2, n1 * n2, block);
+
+    free(block);
+    return;
+}
@@ -0,0 +1,41 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <complex.h>
+
+#define FFT_MAX_FACTORS 32
+#define FFT_BLOCK 8         // strided lines gathered per pass of a 3D transform
+
+
+// STRUCTS ------------------------ //
+
+// Mixed-radix (2, 3, 4, 5) transform of one length: X[k] = sum_n x[n] exp(sign 2PI i kn / N), unnormalized
+typedef struct {
+    size_t n;
+    int sign;                           // +1 or -1, the sign of the exponent
+    size_t n_factors;
+    size_t factor[FFT_MAX_FACTORS];     // radices, first stage first
+    double complex *twiddle;            // exp(sign 2PI i j / N), j < N
+    double complex *scratch;            // two lines, for out-of-place passes
+} FFTPlan;
+
+
+
+size_t fft_good_size(size_t n);
+
+
+bool fft_plan_init(FFTPlan *plan, size_t n, int sign);
+
+
+void fft_plan_free(FFTPlan *plan);
+
+
+void fft_line(const FFTPlan *plan, double complex *data, size_t stride);
+
+
+void fft_3d(const FFTPlan plan[3], double complex *grid);
+
+
+#endif
@@ -0,0 +1,300 @@
+/****************************************************************************************
+ * formfactor.c
+ *
+ * X-ray atomic form factors from the Cromer-Mann four-Gaussian fit
+ *  f(s) = sum_i a_i exp(-b_i s^2) + c,  s = sin(theta)/lambda  (International Tables Vol. C, 6.1.1.4)
+ *  - Coefficients for H-La and a selection of heavier elements; other Z are reported as unknown
+ *  - Each distinct element of a basis gets a table over [0, s_max], rebuilt only when the
+ *    set of elements changes or a shorter radiation needs a wider range (s_max >= FF_S_MAX; the
+ *    fit itself is only published up to s = 2, beyond it the Gaussians are extrapolated)
+ *  - Anomalous dispersion f' + i f'' is tabulated at Mo K-alpha and Cu K-alpha (ITC Vol. C, 4.2.6.8),
+ *    interpolated linearly in lambda between the two and held at the nearer line outside them
+ *
+ ****************************************************************************************/
+
+
+#include "formfactor.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+
+// STRUCTS ------------------------ //
+
+typedef struct {
+    double a[4];
+    double b[4];
+    double c;
+} CromerMann;
+
+
+static const char *FF_SYMBOLS[FF_MAX_Z + 1] = {
+    "-", "H", "He", "Li", "Be", "B", "C", "N", "O", "F", "Ne", "Na", "Mg", "Al", "Si", "P", "S", "Cl", "Ar",
+    "K", "Ca", "Sc", "Ti", "V", "Cr", "Mn", "Fe", "Co", "Ni", "Cu", "Zn", "Ga", "Ge", "As", "Se", "Br", "Kr",
+    "Rb", "Sr", "Y", "Zr", "Nb", "Mo", "Tc", "Ru", "Rh", "Pd", "Ag", "Cd", "In", "Sn", "Sb", "Te", "I", "Xe",
+    "Cs", "Ba", "La", "Ce", "Pr", "Nd", "Pm", "Sm", "Eu", "Gd", "Tb", "Dy", "Ho", "Er", "Tm", "Yb", "Lu",
+    "Hf", "Ta", "W", "Re", "Os", "Ir", "Pt", "Au", "Hg", "Tl", "Pb", "Bi", "Po", "At", "Rn", "Fr", "Ra",
+    "Ac", "Th", "Pa", "U",
+};
+
+
+// Neutral-atom coefficients by Z; elements left out have all-zero entries
+static const CromerMann FF_COEFFS[FF_MAX_Z + 1] = {
+    [1]  = {{0.489918, 0.262003, 0.196767, 0.049879}, {20.6593, 7.74039, 49.5519, 2.20159}, 0.001305},
+    [2]  = {{0.8734, 0.6309, 0.3112, 0.178}, {9.1037, 3.3568, 22.9276, 0.9821}, 0.0064},
+    [3]  = {{1.1282, 0.7508, 0.6175, 0.4653}, {3.9546, 1.0524, 85.3905, 168.261}, 0.0377},
+    [4]  = {{1.5919, 1.1278, 0.5391, 0.7029}, {43.6427, 1.8623, 103.483, 0.542}, 0.0385},
+    [5]  = {{2.0545, 1.3326, 1.0979, 0.7068}, {23.2185, 1.021, 60.3498, 0.1403}, -0.1932},
+    [6]  = {{2.31, 1.02, 1.5886, 0.865}, {20.8439, 10.2075, 0.5687, 51.6512}, 0.2156},
+    [7]  = {{12.2126, 3.1322, 2.0125, 1.1663}, {0.0057, 9.8933, 28.9975, 0.5826}, -11.529},
+    [8]  = {{3.0485, 2.2868, 1.5463, 0.867}, {13.2771, 5.7011, 0.3239, 32.9089}, 0.2508},
+    [9]  = {{3.5392, 2.6412, 1.517, 1.0243}, {10.2825, 4.2944, 0.2615, 26.1476}, 0.2776},
+    [10] = {{3.9553, 3.1125, 1.4546, 1.1251}, {8.4042, 3.4262, 0.2306, 21.7184}, 0.3515},
+    [11] = {{4.7626, 3.1736, 1.2674, 1.1128}, {3.285, 8.8422, 0.3136, 129.424}, 0.676},
+    [12] = {{5.4204, 2.1735, 1.2269, 2.3073}, {2.8275, 79.2611, 0.3808, 7.1937}, 0.8584},
+    [13] = {{6.4202, 1.9002, 1.5936, 1.9646}, {3.0387, 0.7426, 31.5472, 85.0886}, 1.1151},
+    [14] = {{6.2915, 3.0353, 1.9891, 1.541}, {2.4386, 32.3337, 0.6785, 81.6937}, 1.1407},
+    [15] = {{6.4345, 4.1791, 1.78, 1.4908}, {1.9067, 27.157, 0.526, 68.1645}, 1.1149},
+    [16] = {{6.9053, 5.2034, 1.4379, 1.5863}, {1.4679, 22.2151, 0.2536, 56.172}, 0.8669},
+    [17] = {{11.4604, 7.1962, 6.2556, 1.6455}, {0.0104, 1.1662, 18.5194, 47.7784}, -9.5574},
+    [18] = {{7.4845, 6.7723, 0.6539, 1.6442}, {0.9072, 14.8407, 43.8983, 33.3929}, 1.4445},
+    [19] = {{8.2186, 7.4398, 1.0519, 0.8659}, {12.7949, 0.7748, 213.187, 41.6841}, 1.4228},
+    [20] = {{8.6266, 7.3873, 1.5899, 1.0211}, {10.4421, 0.6599, 85.7484, 178.437}, 1.3751},
+    [21] = {{9.189, 7.3679, 1.6409, 1.468}, {9.0213, 0.5729, 136.108, 51.3531}, 1.3329},
+    [22] = {{9.7595, 7.3558, 1.6991, 1.9021}, {7.8508, 0.5, 35.6338, 116.105}, 1.2807},
+    [23] = {{10.2971, 7.3511, 2.0703, 2.0571}, {6.8657, 0.4385, 26.8938, 102.478}, 1.2199},
+    [24] = {{10.6406, 7.3537, 3.324, 1.4922}, {6.1038, 0.392, 20.2626, 98.7399}, 1.1832},
+    [25] = {{11.2819, 7.3573, 3.0193, 2.2441}, {5.3409, 0.3432, 17.8674, 83.7543}, 1.0896},
+    [26] = {{11.7695, 7.3573, 3.5222, 2.3045}, {4.7611, 0.3072, 15.3535, 76.8805}, 1.0369},
+    [27] = {{12.2841, 7.3409, 4.0034, 2.3488}, {4.2791, 0.2784, 13.5359, 71.1692}, 1.0118},
+    [28] = {{12.8376, 7.292, 4.4438, 2.38}, {3.8785, 0.2565, 12.1763, 66.3421}, 1.0341},
+    [29] = {{13.338, 7.1676, 5.6158, 1.6735}, {3.5828, 0.247, 11.3966, 64.8126}, 1.191},
+    [30] = {{14.0743, 7.0318, 5.1652, 2.41}, {3.2655, 0.2333, 10.3163, 58.7097}, 1.3041},
+    [31] = {{15.2354, 6.7006, 4.3591, 2.9623}, {3.0669, 0.2412, 10.7805, 61.4135}, 1.7189},
+    [32] = {{16.0816, 6.3747, 3.7068, 3.683}, {2.8509, 0.2516, 11.4468, 54.7625}, 2.1313},
+    [33] = {{16.6723, 6.0701, 3.4313, 4.2779}, {2.6345, 0.2647, 12.9479, 47.7972}, 2.531},
+    [34] = {{17.0006, 5.8196, 3.9731, 4.3543}, {2.4098, 0.2726, 15.2372, 43.8163}, 2.8409},
+    [35] = {{17.1789, 5.2358, 5.6377, 3.9851}, {2.1723, 16.5796, 0.2609, 41.4328}, 2.9557},
+    [36] = {{17.3555, 6.7286, 5.5493, 3.5375}, {1.9384, 16.5623, 0.2261, 39.3972}, 2.825},
+    [37] = {{17.1784, 9.6435, 5.1399, 1.5292}, {1.7888, 17.3151, 0.2748, 164.934}, 3.4873},
+    [38] = {{17.5663, 9.8184, 5.422, 2.6694}, {1.5564, 14.0988, 0.1664, 132.376}, 2.5064},
+    [39] = {{17.776, 10.2946, 5.72629, 3.26588}, {1.4029, 12.8006, 0.125599, 104.354}, 1.91213},
+    [40] = {{17.8765, 10.948, 5.41732, 3.65721}, {1.27618, 11.916, 0.117622, 87.6627}, 2.06929},
+    [41] = {{17.6142, 12.0144, 4.04183, 3.53346}, {1.18865, 11.766, 0.204785, 69.7957}, 3.75591},
+    [42] = {{3.7025, 17.2356, 12.8876, 3.7429}, {0.2772, 1.0958, 11.004, 61.6584}, 4.3875},
+    [43] = {{19.1301, 11.0948, 4.64901, 2.71263}, {0.864132, 8.14487, 21.5707, 86.8472}, 5.40428},
+    [44] = {{19.2674, 12.9182, 4.86337, 1.56756}, {0.80852, 8.43467, 24.7997, 94.2928}, 5.37874},
+    [45] = {{19.2957, 14.3501, 4.73425, 1.28918}, {0.751536, 8.21758, 25.8749, 98.6062}, 5.328},
+    [46] = {{19.3319, 15.5017, 5.29537, 0.605844}, {0.698655, 7.98929, 25.2052, 76.8986}, 5.26593},
+    [47] = {{19.2808, 16.6885, 4.8045, 1.0463}, {0.6446, 7.4726, 24.6605, 99.8156}, 5.179},
+    [48] = {{19.2214, 17.6444, 4.461, 1.6029}, {0.5946, 6.9089, 24.7008, 87.4825}, 5.0694},
+    [49] = {{19.1624, 18.5596, 4.2948, 2.0396}, {0.5476, 6.3776, 25.8499, 92.8029}, 4.9391},
+    [50] = {{19.1889, 19.1005, 4.4585, 2.4663}, {5.8303, 0.5031, 26.8909, 83.9571}, 4.7821},
+    [51] = {{19.6418, 19.0455, 5.0371, 2.6827}, {5.3034, 0.4607, 27.9074, 75.2825}, 4.5909},
+    [52] = {{19.9644, 19.0138, 6.14487, 2.5239}, {4.81742, 0.420885, 28.5284, 70.8403}, 4.352},
+    [53] = {{20.1472, 18.9949, 7.5138, 2.2735}, {4.347, 0.3814, 27.766, 66.8776}, 4.0712},
+    [54] = {{20.2933, 19.0298, 8.9767, 1.99}, {3.9282, 0.344, 26.4659, 64.2658}, 3.7118},
+    [55] = {{20.3892, 19.1062, 10.662, 1.4953}, {3.569, 0.3107, 24.3879, 213.904}, 3.3352},
+    [56] = {{20.3361, 19.297, 10.888, 2.6959}, {3.216, 0.2756, 20.2073, 167.202}, 2.7731},
+    [57] = {{20.578, 19.599, 11.3727, 3.28719}, {2.94817, 0.244475, 18.7726, 133.124}, 2.14678},
+    [74] = {{29.0818, 15.43, 14.4327, 5.11982}, {1.72029, 9.2259, 0.321703, 57.056}, 9.8875},
+    [78] = {{27.0059, 17.7639, 15.7131, 5.7837}, {1.51293, 8.81174, 0.424593, 38.6103}, 11.6883},
+    [79] = {{16.8819, 18.5913, 25.5582, 5.86}, {0.4611, 8.6216, 1.4826, 36.3956}, 12.0658},
+    [80] = {{20.6809, 19.0417, 21.6575, 5.9676}, {0.545, 8.4484, 1.5729, 38.3246}, 12.6089},
+    [82] = {{31.0617, 13.0637, 18.442, 5.9696}, {0.6902, 2.3576, 8.618, 47.2579}, 13.4118},
+    [83] = {{33.3689, 12.951, 16.5877, 6.4692}, {0.704, 2.9238, 8.7937, 48.0093}, 13.5782},
+    [92] = {{36.0228, 23.4128, 14.9491, 4.188}, {0.5293, 3.3253, 16.0927, 100.613}, 13.3966},
+};
+
+
+// Wavelengths (Angstrom) of the dispersion columns below, ascending
+static const double FF_DISP_WAVELENGTHS[FF_DISP_LINES] = { 0.709300, 1.540562 };
+
+
+// f' and f'' by Z at each dispersion line, { {f', f''} Mo K-alpha, {f', f''} Cu K-alpha }; left out = 0
+static const double FF_DISPERSION[FF_MAX_Z + 1][FF_DISP_LINES][2] = {
+    [3]  = {{-0.0003, 0.0001}, {0.0008, 0.0006}},
+    [4]  = {{0.0005, 0.0002}, {0.0038, 0.0014}},
+    [5]  = {{0.0013, 0.0007}, {0.0090, 0.0039}},
+    [6]  = {{0.0033, 0.0016}, {0.0181, 0.0091}},
+    [7]  = {{0.0061, 0.0033}, {0.0311, 0.0180}},
+    [8]  = {{0.0106, 0.0060}, {0.0492, 0.0322}},
+    [9]  = {{0.0171, 0.0103}, {0.0727, 0.0534}},
+    [10] = {{0.0259, 0.0164}, {0.0971, 0.0833}},
+    [11] = {{0.0362, 0.0249}, {0.1353, 0.1239}},
+    [12] = {{0.0486, 0.0363}, {0.1719, 0.1771}},
+    [13] = {{0.0645, 0.0514}, {0.2130, 0.2455}},
+    [14] = {{0.0817, 0.0704}, {0.2541, 0.3302}},
+    [15] = {{0.1023, 0.0942}, {0.2955, 0.4335}},
+    [16] = {{0.1246, 0.1234}, {0.3331, 0.5567}},
+    [17] = {{0.1484, 0.1585}, {0.3639, 0.7018}},
+    [18] = {{0.1743, 0.2009}, {0.3843, 0.8717}},
+    [19] = {{0.2009, 0.2494}, {0.3868, 1.0657}},
+    [20] = {{0.2262, 0.3064}, {0.3641, 1.2855}},
+    [21] = {{0.2519, 0.3716}, {0.3119, 1.5331}},
+    [22] = {{0.2776, 0.4457}, {0.2191, 1.8069}},
+    [23] = {{0.3005, 0.5294}, {0.0687, 2.1097}},
+    [24] = {{0.3209, 0.6236}, {-0.1635, 2.4439}},
+    [25] = {{0.3368, 0.7283}, {-0.5299, 2.8052}},
+    [26] = {{0.3463, 0.8444}, {-1.1336, 3.1974}},
+    [27] = {{0.3494, 0.9721}, {-2.3653, 3.6143}},
+    [28] = {{0.3393, 1.1124}, {-3.0029, 0.5091}},
+    [29] = {{0.3201, 1.2651}, {-1.9646, 0.5888}},
+    [30] = {{0.2839, 1.4301}, {-1.5491, 0.6778}},
+    [31] = {{0.2307, 1.6083}, {-1.2846, 0.7763}},
+    [32] = {{0.1547, 1.8001}, {-1.0885, 0.8855}},
+    [33] = {{0.0499, 2.0058}, {-0.9300, 1.0051}},
+    [34] = {{-0.0929, 2.2259}, {-0.7943, 1.1372}},
+    [35] = {{-0.2901, 2.4595}, {-0.6763, 1.2805}},
+    [36] = {{-0.5995, 2.7185}, {-0.5653, 1.4385}},
+    [37] = {{-1.0095, 2.9989}, {-0.4751, 1.6010}},
+    [38] = {{-1.5307, 3.2498}, {-0.3816, 1.7822}},
+    [39] = {{-2.7962, 3.5667}, {-0.3104, 1.9812}},
+    [40] = {{-2.9673, 0.5597}, {-0.2670, 2.1873}},
+    [41] = {{-2.0727, 0.6215}, {-0.2463, 2.4023}},
+    [42] = {{-1.6832, 0.6857}, {-0.2509, 2.6281}},
+    [43] = {{-1.3972, 0.7563}, {-0.2553, 2.8629}},
+    [44] = {{-1.2594, 0.8363}, {-0.2596, 3.1161}},
+    [45] = {{-1.1178, 0.9187}, {-0.2716, 3.3872}},
+    [46] = {{-0.9988, 1.0072}, {-0.3014, 3.6689}},
+    [47] = {{-0.8971, 1.1015}, {-0.3433, 3.9601}},
+    [48] = {{-0.8075, 1.2024}, {-0.4098, 4.2715}},
+    [49] = {{-0.7276, 1.3100}, {-0.5002, 4.5981}},
+    [50] = {{-0.6537, 1.4246}, {-0.6103, 4.9380}},
+    [51] = {{-0.5866, 1.5461}, {-0.7440, 5.2986}},
+    [52] = {{-0.5308, 1.6751}, {-0.9003, 5.6667}},
+    [53] = {{-0.4742, 1.8119}, {-1.0930, 6.0448}},
+    [54] = {{-0.4205, 1.9551}, {-1.3196, 6.4382}},
+    [55] = {{-0.3680, 2.1058}, {-1.5931, 6.8456}},
+    [56] = {{-0.3244, 2.2819}, {-1.9142, 7.2701}},
+    [57] = {{-0.2871, 2.4523}, {-2.2803, 7.7024}},
+    [74] = {{-0.8490, 6.8722}, {-5.4734, 5.5774}},
+    [78] = {{-1.7033, 8.3905}, {-4.5932, 6.9264}},
+    [79] = {{-2.0133, 8.8022}, {-4.4390, 7.3540}},
+    [80] = {{-2.3894, 9.2266}, {-4.2930, 7.6860}},
+    [82] = {{-3.3944, 10.1111}, {-4.0753, 8.5060}},
+    [83] = {{-4.1077, 10.2566}, {-4.0111, 8.9310}},
+    [92] = {{-9.6767, 9.6646}, {-5.3600, 13.4090}},
+};
+
+
+
+// Are form-factor coefficients available for Z? (0 = unit point scatterer, always available)
+bool ff_known(int Z) {
+    if (Z == 0) { return true; }
+    if (Z < 0 || Z > FF_MAX_Z) { return false; }
+    return FF_COEFFS[Z].a[0] != 0;
+}
+
+
+const char *ff_symbol(int Z) {
+    if (Z < 0 || Z > FF_MAX_Z) { return "?"; }
+    return FF_SYMBOLS[Z];
+}
+
+
+// Cromer-Mann f(s) evaluated directly (1 for Z = 0, 0 for unknown elements)
+double ff_eval(int Z, double s) {
+    if (Z == 0) { return 1; }
+    if (!ff_known(Z)) { return 0; }
+
+    const CromerMann *cm = &FF_COEFFS[Z];
+    double s2 = s * s;
+    double f = cm->c;
+    for (int i = 0; i < 4; i++) { f += cm->a[i] * exp(-cm->b[i] * s2); }
+    return f;
+}
+
+
+// Anomalous dispersion f' and f'' of an element at a wavelength (both 0 for Z = 0 or lambda <= 0)
+void ff_dispersion(int Z, double wavelength, double *fp, double *fpp) {
+    *fp = *fpp = 0;
+    if (Z <= 0 || Z > FF_MAX_Z || wavelength <= 0) { return; }
+
+    const double (*d)[2] = FF_DISPERSION[Z];
+    const double *w = FF_DISP_WAVELENGTHS;
+    if (wavelength <= w[0]) { *fp = d[0][0]; *fpp = d[0][1]; return; }
+    if (wavelength >= w[FF_DISP_LINES - 1]) { *fp = d[FF_DISP_LINES - 1][0]; *fpp = d[FF_DISP_LINES - 1][1]; return; }
+
+    size_t i = 0;
+    while (wavelength > w[i + 1]) { i++; }
+    double t = (wavelength - w[i]) / (w[i + 1] - w[i]);
+    *fp = d[i][0] + t * (d[i + 1][0] - d[i][0]);
+    *fpp = d[i][1] + t * (d[i + 1][1] - d[i][1]);
+}
+
+
+// Give every table the dispersion terms of a radiation (wavelength 0 = none, f stays real)
+void ff_set_wavelength(FFTables *ff, double wavelength) {
+    if (!ff) { return; }
+
+    ff->wavelength = wavelength;
+    for (size_t e = 0; e < ff->n; e++) { ff_dispersion(ff->Z[e], wavelength, &ff->fp[e], &ff->fpp[e]); }
+}
+
+
+// Table index of an element, -1 if it has none
+long ff_index(const FFTables *ff, int Z) {
+    for (size_t e = 0; e < ff->n; e++) {
+        if (ff->Z[e] == Z) { return (long)e; }
+    }
+    return -1;
+}
+
+
+// Make the tables cover exactly the elements of the atoms (in order of first appearance) for s up to s_max
+//  (1/lambda covers the limiting sphere). Tables are only re-sampled when that list changes or s_max grows
+//  past their range; Z = NULL means unit scatterers throughout
+bool ff_update(FFTables *ff, const int *Z, size_t n_atoms, double s_max) {
+    if (!ff) { return false; }
+
+    int elements[FF_MAX_ELEMENTS];
+    size_t n = 0;
+    for (size_t i = 0; i < n_atoms; i++) {
+        int z = Z ? Z[i] : 0;
+        if (!ff_known(z)) { return false; }
+
+        bool seen = false;
+        for (size_t e = 0; e < n && !seen; e++) { seen = elements[e] == z; }
+        if (seen) { continue; }
+
+        if (n == FF_MAX_ELEMENTS) { return false; }
+        elements[n++] = z;
+    }
+
+    if (isinf(s_max)) { return false; }
+    if (!(s_max > FF_S_MAX)) { s_max = FF_S_MAX; }
+    if (s_max < ff->s_max) { s_max = ff->s_max; }
+    if (ff->table && n == ff->n && s_max == ff->s_max && memcmp(elements, ff->Z, n * sizeof(*elements)) == 0) { return true; }
+
+    size_t samples = (size_t)ceil(s_max / FF_STEP) + 2;
+    if (samples > SIZE_MAX / sizeof(double) / FF_MAX_ELEMENTS) { return false; }
+    double *table = realloc(ff->table, (n ? n : 1) * samples * sizeof(*table));
+    if (!table) { return false; }
+    ff->table = table;
+    ff->samples = samples;
+    ff->s_max = s_max;
+
+    for (size_t e = 0; e < n; e++) {
+        for (size_t i = 0; i < samples; i++) {
+            table[e * samples + i] = ff_eval(elements[e], (double)i * FF_STEP);
+        }
+        ff->Z[e] = elements[e];
+    }
+    ff->n = n;
+    ff_set_wavelength(ff, ff->wavelength);
+
+    return true;
+}
+
+
+void ff_free(FFTables *ff) {
+    if (!ff) { return; }
+
+    free(ff->table);
+    *ff = (FFTables){0};
+
+    return;
+}
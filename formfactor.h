@@ -0,0 +1,67 @@
+#ifndef FORMFACTOR_H
+#define FORMFACTOR_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define FF_MAX_Z 92
+#define FF_MAX_ELEMENTS 8   // distinct elements in one basis
+#define FF_STEP 0.001       // table spacing in sin(theta)/lambda (1/Angstrom)
+#define FF_S_MAX 2.0        // smallest table range (Cu and Mo K-alpha spheres); grown to 1/lambda for shorter radiation
+#define FF_DISP_LINES 2     // wavelengths the anomalous dispersion terms are tabulated at
+
+
+// STRUCTS ------------------------ //
+
+// Atomic form factors f(s), s = sin(theta)/lambda, of the distinct elements of a basis, sampled on a
+//  fine grid so a reflection costs one interpolated lookup per element instead of nine exponentials
+typedef struct {
+    size_t n;                   // distinct elements
+    int Z[FF_MAX_ELEMENTS];     // element of each table, 0 = unit point scatterer (f = 1)
+    double *table;              // n * samples samples
+    size_t samples;             // per table, covering s in [0, s_max]
+    double s_max;
+    double fp[FF_MAX_ELEMENTS];     // anomalous dispersion f' of each table (f = f0(s) + f' + i f'')
+    double fpp[FF_MAX_ELEMENTS];    // f''
+    double wavelength;              // radiation fp/fpp belong to, 0 = no dispersion
+} FFTables;
+
+
+// f(s) of table e, linearly interpolated (held past s_max, which ff_update keeps beyond every reflection asked for)
+static inline double ff_lookup(const FFTables *ff, size_t e, double s) {
+    const double *t = ff->table + e * ff->samples;
+    double x = s * (1.0 / FF_STEP);
+    if (x >= (double)(ff->samples - 1)) { return t[ff->samples - 1]; }
+
+    size_t i = (size_t)x;
+    double w = x - (double)i;
+    return t[i] + w * (t[i + 1] - t[i]);
+}
+
+
+
+bool ff_known(int Z);
+
+
+const char *ff_symbol(int Z);
+
+
+double ff_eval(int Z, double s);
+
+
+void ff_dispersion(int Z, double wavelength, double *fp, double *fpp);
+
+
+void ff_set_wavelength(FFTables *ff, double wavelength);
+
+
+bool ff_update(FFTables *ff, const int *Z, size_t n_atoms, double s_max);
+
+
+long ff_index(const FFTables *ff, int Z);
+
+
+void ff_free(FFTables *ff);
+
+
+#endif
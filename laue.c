@@ -0,0 +1,278 @@
+/****************************************************************************************
+ * laue.c
+ *
+ * Laue symmetry of an arbitrary basis, so structure factors are only summed once per orbit
+ *  - An operation x -> R x + t that maps the atoms onto atoms of the same element and
+ *    displacement (W -> R W R^T) gives F(h) = exp(2PI i h.t) F(R^T h): |F|^2 agrees at h and R^T h
+ *  - Candidate rotations come from the holohedry of the lattice (the most symmetric space group
+ *    of its system) and must keep the reciprocal metric, so |q| and every f(s) are unchanged too
+ *  - t is tried from the images of one atom of the rarest element; atoms are looked up again
+ *    through a hash of their positions, so checking a basis is about linear in its atoms
+ *  - Without anomalous dispersion Friedel's law adds -I
+ *
+ ****************************************************************************************/
+
+
+#include "laue.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sf_engine.h"
+
+
+// STRUCTS ------------------------ //
+
+// Atoms bucketed by position on an m^3 grid over the unit cell
+typedef struct {
+    size_t m;
+    int *head;      // cell -> first atom, -1 if empty
+    int *next;      // atom -> next atom of the same cell, -1 at the end
+} LaueHash;
+
+
+// Rotations of each system's holohedry, parsed from its Hall symbol on first use
+//  (structure factors are only ever filled from one thread)
+static size_t laue_holohedry_n[TRICLINIC + 1];
+static int laue_holohedry_R[TRICLINIC + 1][SG_MAX_POINT_OPS][3][3];
+
+
+// METHODS ------------------------ //
+
+// Most symmetric space group of a crystal system, on the axes cell_matrix builds
+static int laue_holohedry_number(System sys) {
+    switch (sys) {
+        case CUBIC:        return 221;  // Pm-3m
+        case HEXAGONAL:    return 191;  // P6/mmm
+        case RHOMBOHEDRAL: return 166;  // R-3m, rhombohedral axes
+        case TETRAGONAL:   return 123;  // P4/mmm
+        case ORTHORHOMBIC: return 47;   // Pmmm
+        case MONOCLINIC:   return 10;   // P2/m, unique axis b
+        case TRICLINIC:    return 2;    // P-1
+        default:           return 0;
+    }
+}
+
+
+// Holohedry rotations of a system into R; returns their count, 0 for an unknown system
+static size_t laue_holohedry(System sys, int R[SG_MAX_POINT_OPS][3][3]) {
+    if (sys < CUBIC || sys > TRICLINIC) { return 0; }
+
+    if (laue_holohedry_n[sys] == 0) {
+        laue_holohedry_n[sys] = sg_point_ops(laue_holohedry_number(sys), sys == RHOMBOHEDRAL, laue_holohedry_R[sys]);
+    }
+    memcpy(R, laue_holohedry_R[sys], laue_holohedry_n[sys] * sizeof(R[0]));
+
+    return laue_holohedry_n[sys];
+}
+
+
+// Do two tensors agree to LAUE_TOLERANCE of their largest entry?
+static bool laue_close(const Mat3 *A, const Mat3 *B) {
+    double scale = 0, diff = 0;
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            double a = fabs(A->M[r][c]), b = fabs(B->M[r][c]), d = fabs(A->M[r][c] - B->M[r][c]);
+            if (a > scale) { scale = a; }
+            if (b > scale) { scale = b; }
+            if (d > diff) { diff = d; }
+        }
+    }
+    return diff <= LAUE_TOLERANCE * scale;
+}
+
+
+// R T R^T
+static Mat3 laue_conjugate(const int R[3][3], const Mat3 *T) {
+    Mat3 out;
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            double sum = 0;
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 3; j++) { sum += R[r][i] * T->M[i][j] * R[c][j]; }
+            }
+            out.M[r][c] = sum;
+        }
+    }
+    return out;
+}
+
+
+static inline Vec3 laue_rotate(const int R[3][3], Vec3 x) {
+    return (Vec3){
+        R[0][0] * x.x + R[0][1] * x.y + R[0][2] * x.z,
+        R[1][0] * x.x + R[1][1] * x.y + R[1][2] * x.z,
+        R[2][0] * x.x + R[2][1] * x.y + R[2][2] * x.z
+    };
+}
+
+
+// Grid cell index (0 .. m-1) of a fractional coordinate, modulo the lattice
+static inline long laue_cell(double x, size_t m) {
+    long c = (long)floor((x - floor(x)) * (double)m);
+    return c < (long)m ? c : (long)m - 1;
+}
+
+
+static void laue_hash_free(LaueHash *hash) {
+    free(hash->head);
+    free(hash->next);
+    *hash = (LaueHash){0};
+
+    return;
+}
+
+
+// About one atom per cell
+static bool laue_hash_build(LaueHash *hash, const BasisAtoms *bas) {
+    size_t m = (size_t)cbrt((double)bas->n);
+    if (m < 1) { m = 1; }
+    if (m > 64) { m = 64; }
+
+    hash->m = m;
+    hash->head = malloc(m * m * m * sizeof(*hash->head));
+    hash->next = malloc((bas->n ? bas->n : 1) * sizeof(*hash->next));
+    if (!hash->head || !hash->next) {
+        laue_hash_free(hash);
+        return false;
+    }
+
+    for (size_t c = 0; c < m * m * m; c++) { hash->head[c] = -1; }
+    for (size_t i = bas->n; i-- > 0; ) {
+        Vec3 p = bas->pos[i];
+        size_t cell = ((size_t)laue_cell(p.x, m) * m + (size_t)laue_cell(p.y, m)) * m + (size_t)laue_cell(p.z, m);
+        hash->next[i] = hash->head[cell];
+        hash->head[cell] = (int)i;
+    }
+
+    return true;
+}
+
+
+// Atom of element Z at fractional position p (modulo the lattice), -1 if there is none
+//  Only the cells within LAUE_POS_TOLERANCE of p are searched, usually just its own
+static long laue_find(const LaueHash *hash, const BasisAtoms *bas, Vec3 p, int Z) {
+    long m = (long)hash->m;
+    double x[3] = { p.x, p.y, p.z };
+    long lo[3], hi[3];
+    for (int a = 0; a < 3; a++) {
+        double u = x[a] - floor(x[a]);
+        lo[a] = (long)floor((u - LAUE_POS_TOLERANCE) * (double)m);
+        hi[a] = (long)floor((u + LAUE_POS_TOLERANCE) * (double)m);
+    }
+
+    for (long i = lo[0]; i <= hi[0]; i++) {
+        for (long j = lo[1]; j <= hi[1]; j++) {
+            for (long k = lo[2]; k <= hi[2]; k++) {
+                size_t cell = ((size_t)((i % m + m) % m) * (size_t)m + (size_t)((j % m + m) % m)) * (size_t)m + (size_t)((k % m + m) % m);
+                for (int a = hash->head[cell]; a >= 0; a = hash->next[a]) {
+                    if ((bas->Z ? bas->Z[a] : 0) != Z) { continue; }
+
+                    Vec3 d = v3_sub(bas->pos[a], p);
+                    if (fabs(d.x - round(d.x)) <= LAUE_POS_TOLERANCE &&
+                        fabs(d.y - round(d.y)) <= LAUE_POS_TOLERANCE &&
+                        fabs(d.z - round(d.z)) <= LAUE_POS_TOLERANCE) { return a; }
+                }
+            }
+        }
+    }
+
+    return -1;
+}
+
+
+// Does x -> R x + t carry every atom onto an atom of its element and displacement (W -> R W R^T)?
+static bool laue_maps_basis(const LaueHash *hash, const BasisAtoms *bas, const Mat3 *W, const int R[3][3], Vec3 t) {
+    for (size_t i = 0; i < bas->n; i++) {
+        long a = laue_find(hash, bas, v3_add(laue_rotate(R, bas->pos[i]), t), bas->Z ? bas->Z[i] : 0);
+        if (a < 0) { return false; }
+
+        Mat3 W_i = laue_conjugate(R, &W[i]);
+        if (!laue_close(&W[a], &W_i)) { return false; }
+    }
+    return true;
+}
+
+
+static bool laue_contains(const LaueGroup *laue, const int M[3][3]) {
+    for (size_t i = 0; i < laue->n; i++) {
+        if (memcmp(laue->M[i], M, sizeof(laue->M[i])) == 0) { return true; }
+    }
+    return false;
+}
+
+
+// Laue group of a basis on its lattice: the rotations R of the holohedry that keep the reciprocal metric
+//  and map the atoms onto themselves up to a translation, stored as R^T (their action on Miller indices);
+//  friedel adds -I. A basis with no symmetry still gets the identity. False if memory runs out
+bool laue_group(LaueGroup *laue, const BasisAtoms *bas, const Lattice *lattice, bool friedel) {
+    if (!laue || !bas || !lattice) { return false; }
+
+    laue->n = 0;
+
+    int R[SG_MAX_POINT_OPS][3][3];
+    size_t n_R = laue_holohedry(lattice->type, R);
+    if (n_R == 0) { return false; }
+
+    Mat3 G = mat3_metric(lattice->B);
+
+    // Reference atom: the first of the rarest element, which leaves the fewest translations to try
+    size_t ref = 0;
+    if (bas->n) {
+        size_t counts[FF_MAX_Z + 1] = {0};
+        for (size_t i = 0; i < bas->n; i++) {
+            int Z = bas->Z ? bas->Z[i] : 0;
+            if (Z < 0 || Z > FF_MAX_Z) { return false; }
+            counts[Z]++;
+        }
+        for (size_t i = 1; i < bas->n; i++) {
+            if (counts[bas->Z ? bas->Z[i] : 0] < counts[bas->Z ? bas->Z[ref] : 0]) { ref = i; }
+        }
+    }
+    int Z_ref = bas->n && bas->Z ? bas->Z[ref] : 0;
+
+    Mat3 *W = malloc((bas->n ? bas->n : 1) * sizeof(*W));
+    LaueHash hash = {0};
+    if (!W || !laue_hash_build(&hash, bas)) {
+        free(W);
+        return false;
+    }
+    for (size_t i = 0; i < bas->n; i++) { W[i] = sf_displacement(bas, i, lattice->B); }
+
+    for (size_t r = 0; r < n_R; r++) {
+        Mat3 G_r = laue_conjugate(R[r], &G);
+        if (!laue_close(&G_r, &G)) { continue; }
+
+        bool kept = bas->n == 0;
+        if (!kept) {
+            Vec3 image = laue_rotate(R[r], bas->pos[ref]);
+            for (size_t j = 0; j < bas->n && !kept; j++) {
+                if ((bas->Z ? bas->Z[j] : 0) != Z_ref) { continue; }
+                kept = laue_maps_basis(&hash, bas, W, R[r], v3_sub(bas->pos[j], image));
+            }
+        }
+        if (!kept) { continue; }
+
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) { laue->M[laue->n][i][j] = R[r][j][i]; }
+        }
+        laue->n++;
+    }
+
+    // Every holohedry holds -I, so adding it never leaves the table
+    if (friedel) {
+        size_t n = laue->n;
+        for (size_t i = 0; i < n && laue->n < SG_MAX_POINT_OPS; i++) {
+            int M[3][3];
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) { M[r][c] = -laue->M[i][r][c]; }
+            }
+            if (!laue_contains(laue, M)) { memcpy(laue->M[laue->n++], M, sizeof(M)); }
+        }
+    }
+
+    laue_hash_free(&hash);
+    free(W);
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef LAUE_H
+#define LAUE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "crystal.h"
+
+#define LAUE_POS_TOLERANCE 1e-12    // fractional distance a symmetry image may lie from an atom (phase error 2PI h times this)
+#define LAUE_TOLERANCE 1e-9         // relative, for the reciprocal metric and displacement tensors
+
+
+// STRUCTS ------------------------ //
+
+// Integer maps h -> M h of Miller indices under which |F(hkl)|^2 of a basis is unchanged
+typedef struct {
+    size_t n;
+    int M[SG_MAX_POINT_OPS][3][3];
+} LaueGroup;
+
+
+// Image M h of a reflection
+static inline HKL laue_apply(const int M[3][3], HKL p) {
+    return (HKL){
+        M[0][0] * p.h + M[0][1] * p.k + M[0][2] * p.l,
+        M[1][0] * p.h + M[1][1] * p.k + M[1][2] * p.l,
+        M[2][0] * p.h + M[2][1] * p.k + M[2][2] * p.l
+    };
+}
+
+
+
+bool laue_group(LaueGroup *laue, const BasisAtoms *bas, const Lattice *lattice, bool friedel);
+
+
+#endif
@@ -19,35 +19,374 @@ Vec3 v3_unit_normal(Vec3 n) {
 }
 
 
-// // Use Gram-Schmidt to orthonormalize a basis, represented by Mat3 A
-// bool gram_schmidt(const Mat3 A, Mat3 *Out) {
-// 	const double eps  = 1e-12;
-// 	const double eps2 = eps * eps;
+// Greatest common divisor (non-negative, gcd(0,0) = 0)
+int int_gcd(int a, int b) {
+    a = abs(a);
+    b = abs(b);
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+// Extended Euclid: returns g = gcd(a,b) >= 0 and sets x,y such that a*x + b*y = g
+int int_ext_gcd(int a, int b, int *x, int *y) {
+    int old_r = a, r = b;
+    int old_s = 1, s = 0;
+    int old_t = 0, t = 1;
+    while (r != 0) {
+        int q = old_r / r;
+        int tmp;
+        tmp = old_r - q * r; old_r = r; r = tmp;
+        tmp = old_s - q * s; old_s = s; s = tmp;
+        tmp = old_t - q * t; old_t = t; t = tmp;
+    }
+    if (old_r < 0) { old_r = -old_r; old_s = -old_s; old_t = -old_t; }
+    *x = old_s;
+    *y = old_t;
+    return old_r;
+}
+
+
+// Divide an HKL by the gcd of its components (e.g. [200] -> [100]), zero stays zero
+HKL hkl_primitive(HKL a) {
+    int g = int_gcd(int_gcd(a.h, a.k), a.l);
+    if (g == 0) { return a; }
+    return (HKL){ a.h / g, a.k / g, a.l / g };
+}
+
+
+// Integer basis (p1, p2) of the lattice plane h*u + k*v + l*w = 0 for zone [uvw]
+//  With g = gcd(u,v) = a*u + b*v, the vectors (v/g, -u/g, 0) and (a*w, b*w, -g) satisfy
+//  p1 x p2 = [uvw] for a primitive zone, so they span every integer point in the plane
+bool hkl_zone_basis(HKL zone, HKL *p1, HKL *p2) {
+    if (!p1 || !p2) { return false; }
+
+    HKL z = hkl_primitive(zone);
+    if (z.h == 0 && z.k == 0 && z.l == 0) { return false; }
+
+    if (z.h == 0 && z.k == 0) {
+        *p1 = (HKL){1, 0, 0};
+        *p2 = (HKL){0, 1, 0};
+        return true;
+    }
+
+    int a, b;
+    int g = int_ext_gcd(z.h, z.k, &a, &b);
+
+    *p1 = (HKL){ z.k / g, -z.h / g, 0 };
+    *p2 = (HKL){ a * z.l, b * z.l, -g };
+    return true;
+}
+
+
+// Integer vector t with t . zone = 1 for the primitive zone (steps from one Laue layer to the next)
+//  From g = gcd(u,v) = a*u + b*v and 1 = gcd(g,w) = c*g + d*w, t = (c*a, c*b, d)
+bool hkl_zone_offset(HKL zone, HKL *t) {
+    if (!t) { return false; }
+
+    HKL z = hkl_primitive(zone);
+    if (z.h == 0 && z.k == 0 && z.l == 0) { return false; }
+
+    int a, b, c, d;
+    int g = int_ext_gcd(z.h, z.k, &a, &b);
+    int one = int_ext_gcd(g, z.l, &c, &d);
+    if (one != 1) { return false; }
+
+    *t = (HKL){ c * a, c * b, d };
+    return true;
+}
+
+
+// Lagrange-Gauss reduction of a 2D integer basis under metric G (shortest, most orthogonal pair)
+void hkl_reduce_basis(HKL *p1, HKL *p2, Mat3 G) {
+    double n1 = hkl_metric_dot(*p1, *p1, G);
+    double n2 = hkl_metric_dot(*p2, *p2, G);
+    HKL tmp;
+
+    if (n1 > n2) {
+        tmp = *p1; *p1 = *p2; *p2 = tmp;
+        double t = n1; n1 = n2; n2 = t;
+    }
+
+    // Each pass strictly shortens the basis; the cap only guards against round-off cycling
+    for (int iter = 0; iter < 64 && n1 > 0; iter++) {
+        int mu = (int)lround(hkl_metric_dot(*p1, *p2, G) / n1);
+        if (mu != 0) {
+            *p2 = hkl_add(*p2, hkl_scale(*p1, -mu));
+            n2 = hkl_metric_dot(*p2, *p2, G);
+        }
+        if (n2 >= n1) { break; }
+        tmp = *p1; *p1 = *p2; *p2 = tmp;
+        double t = n1; n1 = n2; n2 = t;
+    }
+}
+
+
+// Use Gram-Schmidt to orthonormalize a basis, represented by Mat3 A
+bool gram_schmidt(const Mat3 A, Mat3 *Out) {
+	const double eps  = 1e-12;
+	const double eps2 = eps * eps;
 	
-// 	Vec3 v1 = mat3_col(A, 0);
-// 	Vec3 v2 = mat3_col(A, 1);
-// 	Vec3 v3 = mat3_col(A, 2);
+	Vec3 v1 = mat3_col(A, 0);
+	Vec3 v2 = mat3_col(A, 1);
+	Vec3 v3 = mat3_col(A, 2);
+
+	// e1 = v1 / ||v1||
+	double n1 = v3_dot(v1, v1);
+	if (n1 < eps2) { return false; }
+	Vec3 e1 = v3_scale(v1, 1.0 / sqrt(n1));
+
+	// u2 = v2 - proj of v2 on e1
+	Vec3 u2 = v3_sub(v2, v3_project(v2, e1));
+	double n2 = v3_dot(u2, u2);
+	if (n2 < eps2) { return false; }
+	Vec3 e2 = v3_scale(u2, 1.0 / sqrt(n2));
+
+	// u3 = v3 with components along e1 and e2 removed 
+	Vec3 u3 = v3_sub(v3, v3_project(v3, e1));
+	u3 = v3_sub(u3, v3_project(u3, e2));
+	double n3 = v3_dot(u3, u3);
+	if (n3 < eps2) { return false; }
+	Vec3 e3 = v3_scale(u3, 1.0 / sqrt(n3));
+
+	*Out = v3_to_mat3(e1, e2, e3);
+	return true;
+};
+
+
+
+
+// BATCH KERNELS ------------------ //
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define MATH_X86
+    #include <immintrin.h>
+#endif
+
+
+typedef struct {
+    void (*dot)(Vec3SoA a, Vec3SoA b, size_t n, double *out);
+    void (*dot_v3)(Vec3SoA a, Vec3 b, size_t n, double *out);
+    void (*cross)(Vec3SoA a, Vec3SoA b, size_t n, Vec3SoA out);
+    void (*magnitude)(Vec3SoA a, size_t n, double *out);
+    void (*transform)(Mat3 M, Vec3SoA a, size_t n, Vec3SoA out);
+    void (*hkl_transform)(Mat3 M, HKLSoA a, size_t n, Vec3SoA out);
+    void (*hkl_to_v3)(HKLSoA a, size_t n, Vec3SoA out);
+} MathKernels;
+
+
+// Scalar reference of every kernel (and the tail of the vector ones)
+static void math_dot_scalar(Vec3SoA a, Vec3SoA b, size_t n, double *out) {
+    for (size_t i = 0; i < n; i++) { out[i] = a.x[i] * b.x[i] + a.y[i] * b.y[i] + a.z[i] * b.z[i]; }
+}
+
+
+static void math_dot_v3_scalar(Vec3SoA a, Vec3 b, size_t n, double *out) {
+    for (size_t i = 0; i < n; i++) { out[i] = a.x[i] * b.x + a.y[i] * b.y + a.z[i] * b.z; }
+}
+
+
+static void math_cross_scalar(Vec3SoA a, Vec3SoA b, size_t n, Vec3SoA out) {
+    for (size_t i = 0; i < n; i++) {
+        Vec3 c = v3_cross((Vec3){a.x[i], a.y[i], a.z[i]}, (Vec3){b.x[i], b.y[i], b.z[i]});
+        out.x[i] = c.x;
+        out.y[i] = c.y;
+        out.z[i] = c.z;
+    }
+}
+
+
+static void math_magnitude_scalar(Vec3SoA a, size_t n, double *out) {
+    for (size_t i = 0; i < n; i++) { out[i] = sqrt(a.x[i] * a.x[i] + a.y[i] * a.y[i] + a.z[i] * a.z[i]); }
+}
+
+
+static void math_transform_scalar(Mat3 M, Vec3SoA a, size_t n, Vec3SoA out) {
+    for (size_t i = 0; i < n; i++) {
+        double x = a.x[i], y = a.y[i], z = a.z[i];
+        out.x[i] = x * M.M[0][0] + y * M.M[0][1] + z * M.M[0][2];
+        out.y[i] = x * M.M[1][0] + y * M.M[1][1] + z * M.M[1][2];
+        out.z[i] = x * M.M[2][0] + y * M.M[2][1] + z * M.M[2][2];
+    }
+}
+
+
+static void math_hkl_transform_scalar(Mat3 M, HKLSoA a, size_t n, Vec3SoA out) {
+    for (size_t i = 0; i < n; i++) {
+        double h = a.h[i], k = a.k[i], l = a.l[i];
+        out.x[i] = h * M.M[0][0] + k * M.M[0][1] + l * M.M[0][2];
+        out.y[i] = h * M.M[1][0] + k * M.M[1][1] + l * M.M[1][2];
+        out.z[i] = h * M.M[2][0] + k * M.M[2][1] + l * M.M[2][2];
+    }
+}
+
+
+static void math_hkl_to_v3_scalar(HKLSoA a, size_t n, Vec3SoA out) {
+    for (size_t i = 0; i < n; i++) {
+        out.x[i] = a.h[i];
+        out.y[i] = a.k[i];
+        out.z[i] = a.l[i];
+    }
+}
+
+
+static const MathKernels math_kernels_scalar = {
+    math_dot_scalar,
+    math_dot_v3_scalar,
+    math_cross_scalar,
+    math_magnitude_scalar,
+    math_transform_scalar,
+    math_hkl_transform_scalar,
+    math_hkl_to_v3_scalar
+};
+
+
+#if defined(MATH_X86)
+
+#define MATH_SUFFIX sse2
+#define MATH_TARGET __attribute__((target("sse2")))
+#define MATH_W 2
+#define MATH_SQRT(v) _mm_sqrt_pd((__m128d)(v))
+#include "math_kernel.h"
+#undef MATH_SUFFIX
+#undef MATH_TARGET
+#undef MATH_W
+#undef MATH_SQRT
+
+#define MATH_SUFFIX avx2
+#define MATH_TARGET __attribute__((target("avx2,fma")))
+#define MATH_W 4
+#define MATH_SQRT(v) _mm256_sqrt_pd((__m256d)(v))
+#include "math_kernel.h"
+#undef MATH_SUFFIX
+#undef MATH_TARGET
+#undef MATH_W
+#undef MATH_SQRT
+
+#define MATH_SUFFIX avx512
+#define MATH_TARGET __attribute__((target("avx512f")))
+#define MATH_W 8
+#define MATH_SQRT(v) _mm512_sqrt_pd((__m512d)(v))
+#include "math_kernel.h"
+#undef MATH_SUFFIX
+#undef MATH_TARGET
+#undef MATH_W
+#undef MATH_SQRT
+
+#endif
+
+
+static MathPath math_path = MATH_PATH_AUTO;
+static const MathKernels *math_kernels = NULL;
+
+
+// Can this CPU run the path? Shared by every runtime-dispatched kernel set (these and sf_engine.c)
+bool math_path_supported(MathPath path) {
+    switch (path) {
+        case MATH_PATH_SCALAR: return true;
+#if defined(MATH_X86)
+        case MATH_PATH_SSE2:   return __builtin_cpu_supports("sse2");
+        case MATH_PATH_AVX2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case MATH_PATH_AVX512: return __builtin_cpu_supports("avx512f");
+#endif
+        default:               return false;
+    }
+}
+
+
+// Widest path this CPU supports
+MathPath math_path_widest(void) {
+    const MathPath widest[] = { MATH_PATH_AVX512, MATH_PATH_AVX2, MATH_PATH_SSE2 };
+    for (size_t i = 0; i < sizeof(widest) / sizeof(widest[0]); i++) {
+        if (math_path_supported(widest[i])) { return widest[i]; }
+    }
+    return MATH_PATH_SCALAR;
+}
+
+
+const char *math_path_name(MathPath path) {
+    switch (path) {
+        case MATH_PATH_SCALAR: return "scalar";
+        case MATH_PATH_SSE2:   return "SSE2";
+        case MATH_PATH_AVX2:   return "AVX2";
+        case MATH_PATH_AVX512: return "AVX-512";
+        default:               return "auto";
+    }
+}
 
-// 	// e1 = v1 / ||v1||
-// 	double n1 = v3_dot(v1, v1);
-// 	if (n1 < eps2) { return false; }
-// 	Vec3 e1 = v3_scale(v1, 1.0 / sqrt(n1));
 
-// 	// u2 = v2 - proj of v2 on e1
-// 	Vec3 u2 = v3_sub(v2, v3_proj(v2, e1));
-// 	double n2 = v3_dot(u2, u2);
-// 	if (n2 < eps2) { return false; }
-// 	Vec3 e2 = v3_scale(u2, 1.0 / sqrt(n2));
+// Use the given path for the batch kernels (MATH_PATH_AUTO = widest one the CPU supports); false if the CPU cannot run it
+bool math_batch_select(MathPath path) {
+    if (path == MATH_PATH_AUTO) { path = math_path_widest(); }
+    if (!math_path_supported(path)) { return false; }
 
-// 	// u3 = v3 with components along e1 and e2 removed 
-// 	Vec3 u3 = v3_sub(v3, v3_proj(v3, e1));
-// 	u3 = v3_sub(u3, v3_proj(u3, e2));
-// 	double n3 = v3_dot(u3, u3);
-// 	if (n3 < eps2) { return false; }
-// 	Vec3 e3 = v3_scale(u3, 1.0 / sqrt(n3));
+    switch (path) {
+#if defined(MATH_X86)
+        case MATH_PATH_SSE2:   math_kernels = &math_kernels_sse2; break;
+        case MATH_PATH_AVX2:   math_kernels = &math_kernels_avx2; break;
+        case MATH_PATH_AVX512: math_kernels = &math_kernels_avx512; break;
+#endif
+        default:               math_kernels = &math_kernels_scalar; break;
+    }
+    math_path = path;
 
-// 	*Out = v3_to_mat3(e1, e2, e3);
-// 	return true;
-// };
+    return true;
+}
+
+
+MathPath math_batch_path(void) {
+    if (!math_kernels) { math_batch_select(MATH_PATH_AUTO); }
+    return math_path;
+}
+
+
+static inline const MathKernels *math_batch(void) {
+    if (!math_kernels) { math_batch_select(MATH_PATH_AUTO); }
+    return math_kernels;
+}
+
+
+// out[i] = a_i . b_i
+void v3_soa_dot(Vec3SoA a, Vec3SoA b, size_t n, double *out) {
+    math_batch()->dot(a, b, n, out);
+}
+
+
+// out[i] = a_i . b, e.g. the projections of many points on one axis
+void v3_soa_dot_v3(Vec3SoA a, Vec3 b, size_t n, double *out) {
+    math_batch()->dot_v3(a, b, n, out);
+}
 
 
+// out_i = a_i x b_i (out may be a or b)
+void v3_soa_cross(Vec3SoA a, Vec3SoA b, size_t n, Vec3SoA out) {
+    math_batch()->cross(a, b, n, out);
+}
+
+
+// out[i] = |a_i|
+void v3_soa_magnitude(Vec3SoA a, size_t n, double *out) {
+    math_batch()->magnitude(a, n, out);
+}
+
+
+// out_i = M a_i (out may be a)
+void v3_soa_transform(Mat3 M, Vec3SoA a, size_t n, Vec3SoA out) {
+    math_batch()->transform(M, a, n, out);
+}
+
+
+// out_i = M (h,k,l)_i, e.g. q = B h of many reflections
+void hkl_soa_transform(Mat3 M, HKLSoA a, size_t n, Vec3SoA out) {
+    math_batch()->hkl_transform(M, a, n, out);
+}
+
+
+// out_i = (double)(h,k,l)_i
+void hkl_soa_to_v3(HKLSoA a, size_t n, Vec3SoA out) {
+    math_batch()->hkl_to_v3(a, n, out);
+}
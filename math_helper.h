@@ -33,6 +33,20 @@ typedef struct {
 } HKL;
 
 
+// n vectors as three coordinate arrays (structure-of-arrays), for the batch kernels
+typedef struct {
+    double *x, *y, *z;
+} Vec3SoA;
+
+
+typedef struct {
+    int *h, *k, *l;
+} HKLSoA;
+
+
+typedef enum { MATH_PATH_AUTO, MATH_PATH_SCALAR, MATH_PATH_SSE2, MATH_PATH_AVX2, MATH_PATH_AVX512 } MathPath;
+
+
 // METHODS ------------------------ //
 
 // Construct new Vec3
@@ -131,6 +145,20 @@ static inline Mat3 v3_to_mat3(Vec3 a, Vec3 b, Vec3 c) {
 Vec3 v3_unit_normal(Vec3 n);
 
 
+bool gram_schmidt(const Mat3 A, Mat3 *Out);
+
+
+// Rotate v about a unit axis by angle (radians), Rodrigues' formula
+static inline Vec3 v3_rotate(Vec3 v, Vec3 axis, double angle) {
+    double c = cos(angle);
+    double s = sin(angle);
+    return v3_add(
+        v3_add(v3_scale(v, c), v3_scale(v3_cross(axis, v), s)),
+        v3_scale(axis, v3_dot(axis, v) * (1 - c))
+    );
+}
+
+
 static inline HKL hkl_scale(HKL a, int s)
 {
     return (HKL){ a.h*s, a.k*s, a.l*s };
@@ -177,4 +205,110 @@ static inline Vec3 hkl_to_v3(HKL a) {
 }
 
 
+// Dot product of two HKL under metric tensor G (G = B^T B gives q1 . q2 in reciprocal space)
+static inline double hkl_metric_dot(HKL a, HKL b, Mat3 G) {
+    double ad[3] = {a.h, a.k, a.l};
+    double bd[3] = {b.h, b.k, b.l};
+    double sum = 0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            sum += ad[i] * G.M[i][j] * bd[j];
+        }
+    }
+    return sum;
+}
+
+
+// Metric tensor G = A^T A of a basis stored as column vectors
+static inline Mat3 mat3_metric(Mat3 A) {
+    Mat3 G;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            G.M[i][j] = v3_dot(mat3_col(A, i), mat3_col(A, j));
+        }
+    }
+    return G;
+}
+
+
+// Integer division rounding towards -inf / +inf (b must be non-zero)
+static inline int int_floor_div(int a, int b) {
+    int q = a / b;
+    if ((a % b != 0) && ((a < 0) != (b < 0))) { q--; }
+    return q;
+}
+
+
+static inline int int_ceil_div(int a, int b) {
+    int q = a / b;
+    if ((a % b != 0) && ((a < 0) == (b < 0))) { q++; }
+    return q;
+}
+
+
+// Arrays of a batch from point i on
+static inline Vec3SoA v3_soa_offset(Vec3SoA a, size_t i) {
+    return (Vec3SoA){ a.x + i, a.y + i, a.z + i };
+}
+
+
+static inline HKLSoA hkl_soa_offset(HKLSoA a, size_t i) {
+    return (HKLSoA){ a.h + i, a.k + i, a.l + i };
+}
+
+
+int int_gcd(int a, int b);
+
+
+int int_ext_gcd(int a, int b, int *x, int *y);
+
+
+HKL hkl_primitive(HKL a);
+
+
+bool hkl_zone_basis(HKL zone, HKL *p1, HKL *p2);
+
+
+bool hkl_zone_offset(HKL zone, HKL *t);
+
+
+void hkl_reduce_basis(HKL *p1, HKL *p2, Mat3 G);
+
+
+bool math_path_supported(MathPath path);
+
+
+MathPath math_path_widest(void);
+
+
+const char *math_path_name(MathPath path);
+
+
+bool math_batch_select(MathPath path);
+
+
+MathPath math_batch_path(void);
+
+
+void v3_soa_dot(Vec3SoA a, Vec3SoA b, size_t n, double *out);
+
+
+void v3_soa_dot_v3(Vec3SoA a, Vec3 b, size_t n, double *out);
+
+
+void v3_soa_cross(Vec3SoA a, Vec3SoA b, size_t n, Vec3SoA out);
+
+
+void v3_soa_magnitude(Vec3SoA a, size_t n, double *out);
+
+
+void v3_soa_transform(Mat3 M, Vec3SoA a, size_t n, Vec3SoA out);
+
+
+void hkl_soa_transform(Mat3 M, HKLSoA a, size_t n, Vec3SoA out);
+
+
+void hkl_soa_to_v3(HKLSoA a, size_t n, Vec3SoA out);
+
+
 #endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+/****************************************************************************************
+ * math_kernel.h
+ *
+ * Vector bodies of the structure-of-arrays batch kernels, included by math_helper.c once per
+ *  instruction set (no include guard) with MATH_SUFFIX, MATH_TARGET, MATH_W (doubles per
+ *  vector) and MATH_SQRT (lane-wise square root of one vector) defined
+ *  - Lanes are consecutive points; arrays need no alignment (loads and stores go through memcpy)
+ *  - The last n % MATH_W points take the scalar reference, so results match it to rounding
+ *    (fused multiply-adds where the target has them)
+ *  - Every point is read in full before it is written, so outputs may alias the inputs
+ *
+ ****************************************************************************************/
+
+
+#define MATH_CAT_(a, b) a##_##b
+#define MATH_CAT(a, b) MATH_CAT_(a, b)
+#define MATH_KERNEL(name) MATH_CAT(name, MATH_SUFFIX)
+
+typedef double MATH_KERNEL(vd) __attribute__((vector_size(MATH_W * sizeof(double))));
+typedef int MATH_KERNEL(vi) __attribute__((vector_size(MATH_W * sizeof(int))));
+
+#define vd MATH_KERNEL(vd)
+#define vi MATH_KERNEL(vi)
+#define MATH_LOAD(p) ({ vd v_; __builtin_memcpy(&v_, (p), sizeof(v_)); v_; })
+#define MATH_LOAD_INT(p) ({ vi v_; __builtin_memcpy(&v_, (p), sizeof(v_)); __builtin_convertvector(v_, vd); })
+#define MATH_STORE(p, v) do { vd v_ = (v); __builtin_memcpy((p), &v_, sizeof(v_)); } while (0)
+
+
+MATH_TARGET
+static void MATH_KERNEL(math_dot)(Vec3SoA a, Vec3SoA b, size_t n, double *out) {
+    size_t i = 0;
+    for (; i + MATH_W <= n; i += MATH_W) {
+        vd d = MATH_LOAD(a.x + i) * MATH_LOAD(b.x + i) + MATH_LOAD(a.y + i) * MATH_LOAD(b.y + i) + MATH_LOAD(a.z + i) * MATH_LOAD(b.z + i);
+        MATH_STORE(out + i, d);
+    }
+    math_dot_scalar(v3_soa_offset(a, i), v3_soa_offset(b, i), n - i, out + i);
+}
+
+
+MATH_TARGET
+static void MATH_KERNEL(math_dot_v3)(Vec3SoA a, Vec3 b, size_t n, double *out) {
+    size_t i = 0;
+    for (; i + MATH_W <= n; i += MATH_W) {
+        vd d = MATH_LOAD(a.x + i) * b.x + MATH_LOAD(a.y + i) * b.y + MATH_LOAD(a.z + i) * b.z;
+        MATH_STORE(out + i, d);
+    }
+    math_dot_v3_scalar(v3_soa_offset(a, i), b, n - i, out + i);
+}
+
+
+MATH_TARGET
+static void MATH_KERNEL(math_cross)(Vec3SoA a, Vec3SoA b, size_t n, Vec3SoA out) {
+    size_t i = 0;
+    for (; i + MATH_W <= n; i += MATH_W) {
+        vd ax = MATH_LOAD(a.x + i), ay = MATH_LOAD(a.y + i), az = MATH_LOAD(a.z + i);
+        vd bx = MATH_LOAD(b.x + i), by = MATH_LOAD(b.y + i), bz = MATH_LOAD(b.z + i);
+        MATH_STORE(out.x + i, ay * bz - az * by);
+        MATH_STORE(out.y + i, az * bx - ax * bz);
+        MATH_STORE(out.z + i, ax * by - ay * bx);
+    }
+    math_cross_scalar(v3_soa_offset(a, i), v3_soa_offset(b, i), n - i, v3_soa_offset(out, i));
+}
+
+
+MATH_TARGET
+static void MATH_KERNEL(math_magnitude)(Vec3SoA a, size_t n, double *out) {
+    size_t i = 0;
+    for (; i + MATH_W <= n; i += MATH_W) {
+        vd x = MATH_LOAD(a.x + i), y = MATH_LOAD(a.y + i), z = MATH_LOAD(a.z + i);
+        MATH_STORE(out + i, (vd)MATH_SQRT(x * x + y * y + z * z));
+    }
+    math_magnitude_scalar(v3_soa_offset(a, i), n - i, out + i);
+}
+
+
+MATH_TARGET
+static void MATH_KERNEL(math_transform)(Mat3 M, Vec3SoA a, size_t n, Vec3SoA out) {
+    size_t i = 0;
+    for (; i + MATH_W <= n; i += MATH_W) {
+        vd x = MATH_LOAD(a.x + i), y = MATH_LOAD(a.y + i), z = MATH_LOAD(a.z + i);
+        MATH_STORE(out.x + i, x * M.M[0][0] + y * M.M[0][1] + z * M.M[0][2]);
+        MATH_STORE(out.y + i, x * M.M[1][0] + y * M.M[1][1] + z * M.M[1][2]);
+        MATH_STORE(out.z + i, x * M.M[2][0] + y * M.M[2][1] + z * M.M[2][2]);
+    }
+    math_transform_scalar(M, v3_soa_offset(a, i), n - i, v3_soa_offset(out, i));
+}
+
+
+MATH_TARGET
+static void MATH_KERNEL(math_hkl_transform)(Mat3 M, HKLSoA a, size_t n, Vec3SoA out) {
+    size_t i = 0;
+    for (; i + MATH_W <= n; i += MATH_W) {
+        vd h = MATH_LOAD_INT(a.h + i), k = MATH_LOAD_INT(a.k + i), l = MATH_LOAD_INT(a.l + i);
+        MATH_STORE(out.x + i, h * M.M[0][0] + k * M.M[0][1] + l * M.M[0][2]);
+        MATH_STORE(out.y + i, h * M.M[1][0] + k * M.M[1][1] + l * M.M[1][2]);
+        MATH_STORE(out.z + i, h * M.M[2][0] + k * M.M[2][1] + l * M.M[2][2]);
+    }
+    math_hkl_transform_scalar(M, hkl_soa_offset(a, i), n - i, v3_soa_offset(out, i));
+}
+
+
+MATH_TARGET
+static void MATH_KERNEL(math_hkl_to_v3)(HKLSoA a, size_t n, Vec3SoA out) {
+    size_t i = 0;
+    for (; i + MATH_W <= n; i += MATH_W) {
+        vd h = MATH_LOAD_INT(a.h + i), k = MATH_LOAD_INT(a.k + i), l = MATH_LOAD_INT(a.l + i);
+        MATH_STORE(out.x + i, h);
+        MATH_STORE(out.y + i, k);
+        MATH_STORE(out.z + i, l);
+    }
+    math_hkl_to_v3_scalar(hkl_soa_offset(a, i), n - i, v3_soa_offset(out, i));
+}
+
+
+static const MathKernels MATH_KERNEL(math_kernels) = {
+    MATH_KERNEL(math_dot),
+    MATH_KERNEL(math_dot_v3),
+    MATH_KERNEL(math_cross),
+    MATH_KERNEL(math_magnitude),
+    MATH_KERNEL(math_transform),
+    MATH_KERNEL(math_hkl_transform),
+    MATH_KERNEL(math_hkl_to_v3)
+};
+
+
+#undef vd
+#undef vi
+#undef MATH_LOAD
+#undef MATH_LOAD_INT
+#undef MATH_STORE
+#undef MATH_KERNEL
+#undef MATH_CAT
+#undef MATH_CAT_
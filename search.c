@@ -0,0 +1,462 @@
+/****************************************************************************************
+ * search.c
+ *
+ * Search for the most populated / strongest zone axes of a crystal
+ *  - Scores every primitive zone [uvw] up to a maximum index by the number and summed |F|^2
+ *    of its allowed reflections inside the limiting sphere, read from the reflection cache
+ *  - Zones are scored in parallel; a zone is skipped when an upper bound on its score
+ *    (from the reduced 2D cell of its plane) cannot beat the current K-th best
+ *  - Headless entry point (--search) prints the top K without opening a window
+ *
+ ****************************************************************************************/
+
+
+#include "search.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+
+#if defined(_WIN32) && !defined(__MINGW32__)
+    #define SEARCH_NO_THREADS
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+#define SEARCH_MAX_THREADS 16
+#define SEARCH_CHUNK 8      // zones handed to a worker at a time
+
+
+// Candidate zone with the reduced basis (p1 shortest) of its plane and its score bound
+typedef struct {
+    HKL zone;
+    HKL p1, p2;
+    int count_bound;
+    double intensity_bound;
+} SearchZone;
+
+
+typedef struct {
+    const ReflectionCache *rc;
+    Mat3 G;
+    double r;                   // limiting sphere radius
+    SearchZone *zones;
+    size_t n_zones;
+    SearchRank rank;
+    size_t k;
+
+#if !defined(SEARCH_NO_THREADS)
+    pthread_mutex_t lock;       // guards everything below
+#endif
+    size_t next;
+    ZoneScore top[SEARCH_MAX_K];
+    size_t n_top;
+    size_t scanned, pruned;
+} SearchJob;
+
+
+// Does score a rank above score b? Primary key by rank, then the other key, then the lower-index zone
+static bool score_better(const ZoneScore *a, const ZoneScore *b, SearchRank rank) {
+    if (rank == SEARCH_BY_COUNT) {
+        if (a->count != b->count) { return a->count > b->count; }
+        if (a->intensity != b->intensity) { return a->intensity > b->intensity; }
+    }
+    else {
+        if (a->intensity != b->intensity) { return a->intensity > b->intensity; }
+        if (a->count != b->count) { return a->count > b->count; }
+    }
+
+    int na = abs(a->zone.h) + abs(a->zone.k) + abs(a->zone.l);
+    int nb = abs(b->zone.h) + abs(b->zone.k) + abs(b->zone.l);
+    if (na != nb) { return na < nb; }
+    if (a->zone.h != b->zone.h) { return a->zone.h > b->zone.h; }
+    if (a->zone.k != b->zone.k) { return a->zone.k > b->zone.k; }
+    return a->zone.l > b->zone.l;
+}
+
+
+// Insert into the sorted top list if the score makes the cut
+static void top_insert(ZoneScore *top, size_t *n_top, size_t k, const ZoneScore *score, SearchRank rank) {
+    size_t i = *n_top;
+    if (i == k) {
+        if (!score_better(score, &top[k - 1], rank)) { return; }
+        i = k - 1;
+    }
+    else { (*n_top)++; }
+
+    while (i > 0 && score_better(score, &top[i - 1], rank)) {
+        top[i] = top[i - 1];
+        i--;
+    }
+    top[i] = *score;
+}
+
+
+// 2D Gram entries of a zone's plane basis under the reciprocal metric
+static void plane_gram(const SearchZone *z, Mat3 G, double *g11, double *g12, double *g22) {
+    *g11 = hkl_metric_dot(z->p1, z->p1, G);
+    *g12 = hkl_metric_dot(z->p1, z->p2, G);
+    *g22 = hkl_metric_dot(z->p2, z->p2, G);
+}
+
+
+// Upper bound on the number of plane points (origin excluded) inside the sphere
+//  With p1 the shortest vector, the points lie on rows parallel to p1 spaced by h = area / |p1|;
+//  at most 2*floor(r/h) + 1 rows cross the disc, each holding at most floor(2r/|p1|) + 1 points
+static int count_bound(const SearchZone *z, Mat3 G, double r) {
+    double g11, g12, g22;
+    plane_gram(z, G, &g11, &g12, &g22);
+
+    double det = g11 * g22 - g12 * g12;
+    if (g11 <= 0 || det <= 0) { return 0; }
+
+    double len1 = sqrt(g11);
+    double spacing = sqrt(det) / len1;
+
+    double rows = 2 * floor(r / spacing + 1e-9) + 1;
+    double per_row = floor(2 * r / len1 + 1e-9) + 1;
+    double bound = rows * per_row - 1;
+
+    return bound > INT_MAX ? INT_MAX : (int)bound;
+}
+
+
+// Exact score: walk the plane points m*p1 + n*p2 inside the sphere and look each up in the cache
+static ZoneScore score_zone(const SearchZone *z, const ReflectionCache *rc, Mat3 G, double r) {
+    ZoneScore score = { .zone = z->zone, .count = 0, .intensity = 0 };
+
+    double g11, g12, g22;
+    plane_gram(z, G, &g11, &g12, &g22);
+    double det = g11 * g22 - g12 * g12;
+    if (det <= 0) { return score; }
+
+    double r2 = r * r;
+    int m_max = (int)floor(r * sqrt(g22 / det) + 1e-9);
+
+    for (int m = -m_max; m <= m_max; m++) {
+        // g22 n^2 + 2 g12 m n + g11 m^2 <= r^2
+        double disc = g12 * g12 * m * m - g22 * (g11 * m * m - r2);
+        if (disc < 0) { continue; }
+        double root = sqrt(disc);
+        int n_lo = (int)ceil((-g12 * m - root) / g22 - 1e-9);
+        int n_hi = (int)floor((-g12 * m + root) / g22 + 1e-9);
+
+        for (int n = n_lo; n <= n_hi; n++) {
+            if (m == 0 && n == 0) { continue; }
+
+            HKL plane = hkl_add(hkl_scale(z->p1, m), hkl_scale(z->p2, n));
+            long slot = rc_find(rc, plane);
+            if (slot < 0 || rc->intensity[slot] < SEARCH_MIN_INTENSITY) { continue; }
+
+            score.count++;
+            score.intensity += rc->intensity[slot];
+        }
+    }
+
+    return score;
+}
+
+
+// Worker: take chunks of zones, skip the ones whose bound cannot make the top K, score the rest
+static void *search_worker(void *arg) {
+    SearchJob *job = arg;
+    ZoneScore local[SEARCH_MAX_K];
+
+    for (;;) {
+#if !defined(SEARCH_NO_THREADS)
+        pthread_mutex_lock(&job->lock);
+#endif
+        size_t begin = job->next;
+        size_t end = begin + SEARCH_CHUNK < job->n_zones ? begin + SEARCH_CHUNK : job->n_zones;
+        job->next = end;
+
+        // Snapshot of the cut-off; it only rises, so a stale copy prunes less but never wrongly
+        bool full = job->n_top == job->k;
+        ZoneScore kth = full ? job->top[job->k - 1] : (ZoneScore){0};
+#if !defined(SEARCH_NO_THREADS)
+        pthread_mutex_unlock(&job->lock);
+#endif
+        if (begin >= end) { break; }
+
+        size_t n_local = 0, pruned = 0;
+        for (size_t i = begin; i < end; i++) {
+            const SearchZone *z = &job->zones[i];
+            ZoneScore bound = { .zone = z->zone, .count = z->count_bound, .intensity = z->intensity_bound };
+            if (full && !score_better(&bound, &kth, job->rank)) { pruned++; continue; }
+
+            ZoneScore score = score_zone(z, job->rc, job->G, job->r);
+            top_insert(local, &n_local, job->k, &score, job->rank);
+        }
+
+#if !defined(SEARCH_NO_THREADS)
+        pthread_mutex_lock(&job->lock);
+#endif
+        for (size_t i = 0; i < n_local; i++) { top_insert(job->top, &job->n_top, job->k, &local[i], job->rank); }
+        job->scanned += (end - begin) - pruned;
+        job->pruned += pruned;
+#if !defined(SEARCH_NO_THREADS)
+        pthread_mutex_unlock(&job->lock);
+#endif
+    }
+
+    return NULL;
+}
+
+
+static int cmp_desc(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x < y) - (x > y);
+}
+
+
+// Zones with the loosest bound first, so strong zones fill the top K early and tighten the cut-off
+static int zone_count_cmp(const void *a, const void *b) {
+    const SearchZone *za = a;
+    const SearchZone *zb = b;
+    if (za->count_bound != zb->count_bound) { return za->count_bound > zb->count_bound ? -1 : 1; }
+    return (za->intensity_bound < zb->intensity_bound) - (za->intensity_bound > zb->intensity_bound);
+}
+
+
+static int zone_intensity_cmp(const void *a, const void *b) {
+    const SearchZone *za = a;
+    const SearchZone *zb = b;
+    if (za->intensity_bound != zb->intensity_bound) { return za->intensity_bound > zb->intensity_bound ? -1 : 1; }
+    return (za->count_bound < zb->count_bound) - (za->count_bound > zb->count_bound);
+}
+
+
+static int search_threads(void) {
+#if defined(SEARCH_NO_THREADS)
+    return 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) { return 1; }
+    return n > SEARCH_MAX_THREADS ? SEARCH_MAX_THREADS : (int)n;
+#endif
+}
+
+
+// Rank every primitive zone with |u|,|v|,|w| <= max_index and keep the best k in out (best first)
+//  Scores come from the crystal's reflection cache, brought up to date for the wavelength first;
+//  the crystal's projected zone is left untouched
+bool zone_search(Crystal *crystal, double wavelength, int max_index, SearchRank rank, size_t k, ZoneSearch *out) {
+    if (!crystal || !crystal->space || !out || max_index < 1 || k < 1 || k > SEARCH_MAX_K) { return false; }
+
+    HKL current = crystal->space->zone;
+    if (current.h == 0 && current.k == 0 && current.l == 0) { current = (HKL){0, 0, 1}; }
+    if (!crystal_update(crystal, current, wavelength)) { return false; }
+
+    const ReflectionCache *rc = crystal->cache;
+    double r = limiting_radius(wavelength);
+    Mat3 G = mat3_metric(crystal->lattice.B);
+
+    // Allowed intensities, strongest first, as prefix sums: the best any zone with c points can reach
+    double *prefix = malloc((rc->n + 1) * sizeof(*prefix));
+    if (!prefix) { return false; }
+    size_t n_allowed = 0;
+    for (size_t i = 0; i < rc->n; i++) {
+        if (rc->intensity[i] >= SEARCH_MIN_INTENSITY) { prefix[1 + n_allowed++] = rc->intensity[i]; }
+    }
+    qsort(prefix + 1, n_allowed, sizeof(*prefix), cmp_desc);
+    prefix[0] = 0;
+    for (size_t i = 1; i <= n_allowed; i++) { prefix[i] += prefix[i - 1]; }
+
+    // Canonical zones: primitive, first non-zero index positive
+    size_t side = 2 * (size_t)max_index + 1;
+    SearchZone *zones = malloc(side * side * side / 2 * sizeof(*zones));
+    if (!zones) { free(prefix); return false; }
+    size_t n_zones = 0;
+
+    for (int u = 0; u <= max_index; u++) {
+        for (int v = (u == 0 ? 0 : -max_index); v <= max_index; v++) {
+            for (int w = (u == 0 && v == 0 ? 1 : -max_index); w <= max_index; w++) {
+                if (int_gcd(int_gcd(u, v), w) != 1) { continue; }
+
+                SearchZone *z = &zones[n_zones];
+                z->zone = (HKL){u, v, w};
+                if (!hkl_zone_basis(z->zone, &z->p1, &z->p2)) { continue; }
+                hkl_reduce_basis(&z->p1, &z->p2, G);
+
+                int c = count_bound(z, G, r);
+                if ((size_t)c > n_allowed) { c = (int)n_allowed; }
+                z->count_bound = c;
+                z->intensity_bound = prefix[c];
+                n_zones++;
+            }
+        }
+    }
+    free(prefix);
+
+    qsort(zones, n_zones, sizeof(*zones), rank == SEARCH_BY_COUNT ? zone_count_cmp : zone_intensity_cmp);
+
+    SearchJob job = {
+        .rc = rc, .G = G, .r = r,
+        .zones = zones, .n_zones = n_zones,
+        .rank = rank, .k = k
+    };
+
+    int threads = search_threads();
+    if ((size_t)threads > (n_zones + SEARCH_CHUNK - 1) / SEARCH_CHUNK) { threads = (int)((n_zones + SEARCH_CHUNK - 1) / SEARCH_CHUNK); }
+    if (threads < 1) { threads = 1; }
+
+#if defined(SEARCH_NO_THREADS)
+    search_worker(&job);
+#else
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_t ids[SEARCH_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&ids[started], NULL, search_worker, &job) != 0) { break; }
+        started++;
+    }
+    search_worker(&job);
+    for (int i = 0; i < started; i++) { pthread_join(ids[i], NULL); }
+    pthread_mutex_destroy(&job.lock);
+    threads = started + 1;
+#endif
+
+    free(zones);
+
+    memcpy(out->top, job.top, job.n_top * sizeof(*job.top));
+    out->n = job.n_top;
+    out->max_index = max_index;
+    out->rank = rank;
+    out->scanned = job.scanned;
+    out->pruned = job.pruned;
+    out->threads = threads;
+    out->lattice = crystal->lattice;
+    out->basis_type = crystal->basis->type;
+    out->element = crystal->basis->element;
+    out->anomalous = crystal->basis->anomalous;
+    out->b_iso = crystal->basis->b_iso;
+    out->space_group = crystal->group->number;
+    out->wavelength = wavelength;
+
+    return true;
+}
+
+
+// Were the results computed for this crystal's lattice parameters, basis, element, dispersion, Biso, space group and radiation?
+bool zone_search_matches(const ZoneSearch *zs, const Crystal *crystal, double wavelength) {
+    if (!zs || !crystal || zs->n == 0) { return false; }
+
+    const Lattice *a = &zs->lattice;
+    const Lattice *b = &crystal->lattice;
+    return a->type == b->type && a->a == b->a && a->b == b->b && a->c == b->c &&
+           a->alpha == b->alpha && a->beta == b->beta && a->gamma == b->gamma &&
+           zs->basis_type == crystal->basis->type && zs->element == crystal->basis->element &&
+           zs->anomalous == crystal->basis->anomalous && zs->b_iso == crystal->basis->b_iso &&
+           zs->space_group == crystal->group->number &&
+           zs->wavelength == wavelength;
+}
+
+
+// Case-insensitive lookup of a name in a ';'-separated option list (as used by the GUI dropdowns)
+static int option_index(const char *list, const char *name) {
+    int index = 0;
+    const char *p = list;
+    while (*p) {
+        size_t len = strcspn(p, ";");
+        size_t i = 0;
+        while (i < len && name[i] && toupper((unsigned char)name[i]) == p[i]) { i++; }
+        if (i == len && name[i] == '\0') { return index; }
+
+        p += len;
+        if (*p == ';') { p++; }
+        index++;
+    }
+    return -1;
+}
+
+
+// Headless entry point:
+//  --search SYSTEM BASIS a b c alpha beta gamma [max_index] [k] [count|intensity] [wavelength] [space_group] [Z] [normal|anomalous] [Biso]
+int zone_search_cli(int argc, char **argv) {
+    if (argc < 10) {
+        fprintf(stderr, "usage: %s --search SYSTEM BASIS a b c alpha beta gamma [max_index] [k] [count|intensity] [wavelength] [space_group] [Z] [normal|anomalous] [Biso]\n", argv[0]);
+        return 1;
+    }
+
+    int sys = option_index("CUBIC;TETRAGONAL;HEXAGONAL;ORTHORHOMBIC;RHOMBOHEDRAL;MONOCLINIC;TRICLINIC", argv[2]);
+    int bas = option_index("PRIMITIVE;BODY_CENTERED;FACE_CENTERED;BASE_CENTERED", argv[3]);
+    if (sys < 0 || bas < 0) {
+        fprintf(stderr, "unknown crystal system or basis: %s %s\n", argv[2], argv[3]);
+        return 1;
+    }
+
+    double p[6];
+    for (int i = 0; i < 6; i++) { p[i] = atof(argv[4 + i]); }
+
+    int max_index = argc > 10 ? atoi(argv[10]) : SEARCH_DEFAULT_INDEX;
+    int k = argc > 11 ? atoi(argv[11]) : SEARCH_DEFAULT_K;
+    SearchRank rank = (argc > 12 && strcmp(argv[12], "intensity") == 0) ? SEARCH_BY_INTENSITY : SEARCH_BY_COUNT;
+    double wavelength = argc > 13 ? atof(argv[13]) : CU_KA1;
+    int space_group = argc > 14 ? atoi(argv[14]) : 0;
+    int element = argc > 15 ? atoi(argv[15]) : 0;
+    bool anomalous = argc > 16 && strcmp(argv[16], "anomalous") == 0;
+    double b_iso = argc > 17 ? atof(argv[17]) : 0;
+
+    if (!validate_lat_params((System)sys, p[0], p[1], p[2], p[3], p[4], p[5]) || !basis_valid((System)sys, (BasisType)bas)) {
+        fprintf(stderr, "invalid lattice parameters or basis for %s\n", argv[2]);
+        return 1;
+    }
+
+    if (!space_group_valid((System)sys, (BasisType)bas, space_group)) {
+        fprintf(stderr, "space group %d does not fit %s %s\n", space_group, argv[2], argv[3]);
+        return 1;
+    }
+
+    if (b_iso < 0) {
+        fprintf(stderr, "Biso must not be negative\n");
+        return 1;
+    }
+
+    if (!ff_known(element)) {
+        fprintf(stderr, "no form factor for Z = %d\n", element);
+        return 1;
+    }
+
+    Crystal *crystal = crystal_init(p[0], p[1], p[2], p[3], p[4], p[5]);
+    if (!crystal) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    // The group's setting follows the crystal system, so set that first
+    crystal->lattice.type = (System)sys;
+    crystal->basis->type = (BasisType)bas;
+    crystal->basis->element = element;
+    crystal->basis->anomalous = anomalous;
+    crystal->basis->b_iso = b_iso;
+    if (!crystal_set_space_group(crystal, space_group) ||
+        !generate_space(crystal, (System)sys, (BasisType)bas, (HKL){0, 0, 1}, wavelength)) {
+        fprintf(stderr, "space generation failed\n");
+        crystal_free(crystal);
+        return 1;
+    }
+
+    ZoneSearch zs;
+    if (k < 1 || k > SEARCH_MAX_K || !zone_search(crystal, wavelength, max_index, rank, (size_t)k, &zs)) {
+        fprintf(stderr, "zone search failed (max_index >= 1, 1 <= k <= %d)\n", SEARCH_MAX_K);
+        crystal_free(crystal);
+        return 1;
+    }
+
+    printf("# top %zu zones up to index %d by %s, lambda = %.6f A, space group %s, %s atoms%s, Biso = %.2f A^2 (%zu scored, %zu pruned, %d threads)\n",
+           zs.n, zs.max_index, rank == SEARCH_BY_COUNT ? "count" : "intensity", wavelength, sg_symbol(space_group),
+           element ? ff_symbol(element) : "point", anomalous ? " with f', f''" : "", b_iso,
+           zs.scanned, zs.pruned, zs.threads);
+    printf("# rank  zone          count  sum|F|^2\n");
+    for (size_t i = 0; i < zs.n; i++) {
+        printf("%6zu  [%3d %3d %3d]  %5d  %.4f\n", i + 1, zs.top[i].zone.h, zs.top[i].zone.k, zs.top[i].zone.l, zs.top[i].count, zs.top[i].intensity);
+    }
+
+    crystal_free(crystal);
+    return 0;
+}
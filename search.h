@@ -0,0 +1,57 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "crystal.h"
+
+#define SEARCH_MAX_K 32             // most zones a search keeps
+#define SEARCH_DEFAULT_INDEX 8      // zones [uvw] with |u|,|v|,|w| <= 8
+#define SEARCH_DEFAULT_K 5
+#define SEARCH_MIN_INTENSITY 1e-6   // |F|^2 below this counts as extinct (same cut as the plot)
+
+
+// STRUCTS ------------------------ //
+
+typedef enum { SEARCH_BY_COUNT, SEARCH_BY_INTENSITY } SearchRank;
+
+
+typedef struct {
+    HKL zone;           // primitive, first non-zero index positive ([uvw] and [-u-v-w] share a plane)
+    int count;          // allowed reflections in the zone plane inside the limiting sphere (origin excluded)
+    double intensity;   // their summed |F|^2
+} ZoneScore;
+
+
+typedef struct {
+    ZoneScore top[SEARCH_MAX_K];   // best first
+    size_t n;
+
+    int max_index;
+    SearchRank rank;
+    size_t scanned;     // zones scored in full
+    size_t pruned;      // zones skipped because their upper bound could not reach the top K
+    int threads;
+
+    // Key: the crystal and radiation the results belong to
+    Lattice lattice;
+    BasisType basis_type;
+    int element;
+    bool anomalous;
+    double b_iso;
+    int space_group;
+    double wavelength;
+} ZoneSearch;
+
+
+
+bool zone_search(Crystal *crystal, double wavelength, int max_index, SearchRank rank, size_t k, ZoneSearch *out);
+
+
+bool zone_search_matches(const ZoneSearch *zs, const Crystal *crystal, double wavelength);
+
+
+int zone_search_cli(int argc, char **argv);
+
+
+#endif
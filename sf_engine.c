@@ -0,0 +1,380 @@
+/****************************************************************************************
+ * sf_engine.c
+ *
+ * Structure-factor engine: |F(hkl)|^2 for many reflections over a SoA atom layout
+ *  - Atoms are grouped by element; each reflection looks up f(s) once per element and sums
+ *    cos and sin of the phases per element, so complex (anomalous) form factors and the
+ *    Friedel mate -h come from the same partial sums
+ *  - Scalar path advances each atom's phase along l by complex multiplication (one cexp
+ *    per atom per hkl row), re-normalized every SF_RENORM steps
+ *  - Debye-Waller factors T = exp(-h^T W h) are quadratic in l along a row, so they advance by
+ *    two multiplies per step (T *= R, R *= K) from one exponential pair at the start of the row
+ *  - Vector paths (SSE2 / AVX2 / AVX-512) run the same recurrence with one atom per lane,
+ *    starting each row from a polynomial sincos (kernel body in sf_kernel.h)
+ *  - The path is picked once at runtime from cpuid (math_path_widest); sf_engine_select forces one
+ *
+ ****************************************************************************************/
+
+
+#include "sf_engine.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define SF_X86
+#endif
+
+#define SF_ALIGN 64     // bytes; one cache line, and a whole AVX-512 vector
+#define SF_RENORM 32    // phase-recurrence steps between re-normalizations
+
+
+static void *sf_alloc(size_t bytes) {
+    bytes = (bytes + SF_ALIGN - 1) / SF_ALIGN * SF_ALIGN;
+#if defined(_WIN32)
+    return _aligned_malloc(bytes, SF_ALIGN);
+#else
+    return aligned_alloc(SF_ALIGN, bytes);
+#endif
+}
+
+
+static void sf_free(void *p) {
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+
+void sf_atoms_free(SFAtoms *soa) {
+    if (!soa) { return; }
+
+    sf_free(soa->x);
+    sf_free(soa->y);
+    sf_free(soa->z);
+    sf_free(soa->f);
+    sf_free(soa->w11);
+    sf_free(soa->w22);
+    sf_free(soa->w33);
+    sf_free(soa->w12);
+    sf_free(soa->w13);
+    sf_free(soa->w23);
+    *soa = (SFAtoms){0};
+
+    return;
+}
+
+
+// Debye-Waller exponent matrix of atom i in index space, h^T W h = B s^2 + 2PI^2 sum h_i h_j a*_i a*_j U_ij,
+//  for the reciprocal basis B (which carries the 2PI, so s^2 = h^T G h / 16PI^2 and a*_i = |b_i| / 2PI)
+Mat3 sf_displacement(const BasisAtoms *bas, size_t i, Mat3 B) {
+    Mat3 G = mat3_metric(B);
+    double len[3] = { v3_magnitude(mat3_col(B, 0)), v3_magnitude(mat3_col(B, 1)), v3_magnitude(mat3_col(B, 2)) };
+    double b_iso = bas->Biso ? bas->Biso[i] : 0;
+
+    Mat3 W;
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            W.M[r][c] = b_iso * G.M[r][c] / (16 * PI * PI);
+            if (bas->U) { W.M[r][c] += 0.5 * len[r] * len[c] * bas->U[i].M[r][c]; }
+        }
+    }
+    return W;
+}
+
+
+// Copy the basis positions and displacement exponents into the SoA arrays, grouped by element (bas->ff must
+//  cover bas->Z). Every group but the last is padded with f = 0 atoms to a whole cache line, so a vector never
+//  mixes elements; the last is padded too, so vector paths load full vectors
+bool sf_atoms_pack(SFAtoms *soa, const BasisAtoms *bas, Mat3 B) {
+    if (!soa || !bas) { return false; }
+
+    size_t lanes = SF_ALIGN / sizeof(double);
+    size_t n_elem = bas->ff.n ? bas->ff.n : 1;
+
+    long *group = malloc((bas->n ? bas->n : 1) * sizeof(*group));
+    if (!group) { return false; }
+
+    size_t counts[FF_MAX_ELEMENTS] = {0};
+    for (size_t i = 0; i < bas->n; i++) {
+        group[i] = bas->ff.n ? ff_index(&bas->ff, bas->Z ? bas->Z[i] : 0) : 0;
+        if (group[i] < 0) { free(group); return false; }
+        counts[group[i]]++;
+    }
+
+    size_t padded = 0;
+    for (size_t e = 0; e < n_elem; e++) { padded += (counts[e] + lanes - 1) / lanes * lanes; }
+
+    if (padded > soa->cap) {
+        SFAtoms grown = { .cap = padded };
+        grown.x = sf_alloc(padded * sizeof(double));
+        grown.y = sf_alloc(padded * sizeof(double));
+        grown.z = sf_alloc(padded * sizeof(double));
+        grown.f = sf_alloc(padded * sizeof(double));
+        grown.w11 = sf_alloc(padded * sizeof(double));
+        grown.w22 = sf_alloc(padded * sizeof(double));
+        grown.w33 = sf_alloc(padded * sizeof(double));
+        grown.w12 = sf_alloc(padded * sizeof(double));
+        grown.w13 = sf_alloc(padded * sizeof(double));
+        grown.w23 = sf_alloc(padded * sizeof(double));
+        if (!grown.x || !grown.y || !grown.z || !grown.f ||
+            !grown.w11 || !grown.w22 || !grown.w33 || !grown.w12 || !grown.w13 || !grown.w23) {
+            sf_atoms_free(&grown);
+            free(group);
+            return false;
+        }
+        sf_atoms_free(soa);
+        *soa = grown;
+    }
+
+    for (size_t i = 0; i < soa->cap; i++) {
+        soa->x[i] = soa->y[i] = soa->z[i] = soa->f[i] = 0;
+        soa->w11[i] = soa->w22[i] = soa->w33[i] = soa->w12[i] = soa->w13[i] = soa->w23[i] = 0;
+    }
+    soa->thermal = false;
+
+    size_t slot = 0;
+    for (size_t e = 0; e < n_elem; e++) {
+        soa->group[e] = slot;
+        if (counts[e] == 0) { continue; }
+
+        size_t start = slot;
+        for (size_t i = 0; i < bas->n; i++) {
+            if (group[i] != (long)e) { continue; }
+            soa->x[slot] = bas->pos[i].x;
+            soa->y[slot] = bas->pos[i].y;
+            soa->z[slot] = bas->pos[i].z;
+            soa->f[slot] = 1.0;
+
+            Mat3 W = sf_displacement(bas, i, B);
+            soa->w11[slot] = W.M[0][0];
+            soa->w22[slot] = W.M[1][1];
+            soa->w33[slot] = W.M[2][2];
+            soa->w12[slot] = W.M[0][1];
+            soa->w13[slot] = W.M[0][2];
+            soa->w23[slot] = W.M[1][2];
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) { soa->thermal |= W.M[r][c] != 0; }
+            }
+            slot++;
+        }
+        if (e + 1 < n_elem) { slot = (slot - start + lanes - 1) / lanes * lanes + start; }
+    }
+    soa->group[n_elem] = slot;
+    soa->n_groups = n_elem;
+    soa->n = slot;
+    soa->ff = &bas->ff;
+
+    free(group);
+    return true;
+}
+
+
+// Real part f0(s) + f' of each element's form factor at the reflection's sin(theta)/lambda (1 without tables)
+static inline void sf_form_factors(const SFAtoms *atoms, Vec3 q, double *f_re) {
+    const FFTables *ff = atoms->ff;
+    if (!ff || ff->n == 0) {
+        f_re[0] = 1;
+        return;
+    }
+
+    double s = v3_magnitude(q) / (4 * PI);
+    for (size_t e = 0; e < ff->n; e++) { f_re[e] = ff_lookup(ff, e, s) + ff->fp[e]; }
+}
+
+
+// Imaginary part f'' of each element's form factor; it does not depend on the reflection
+static inline void sf_dispersion(const SFAtoms *atoms, double *f_im) {
+    const FFTables *ff = atoms->ff;
+    for (size_t e = 0; e < atoms->n_groups; e++) { f_im[e] = ff && e < ff->n ? ff->fpp[e] : 0; }
+}
+
+
+// |F(h)|^2, and |F(-h)|^2 into *friedel if it is wanted, from the element-weighted phase sums
+//  A = sum f_re C_e, B = sum f_im S_e, C = sum f_re S_e, D = sum f_im C_e  (C_e, S_e: sums of cos, sin over
+//  element e): with f_e = f_re + i f_im, F(+-h) = sum_e f_e (C_e +- i S_e) = (A -+ B) + i (D +- C)
+static inline double sf_friedel_pair(double A, double B, double C, double D, double *friedel) {
+    if (friedel) { *friedel = (A + B) * (A + B) + (D - C) * (D - C); }
+    return (A - B) * (A - B) + (C + D) * (C + D);
+}
+
+
+// Scalar path: runs of consecutive l at fixed (h,k) evaluate exp(2PI i (hx + ky + lz)) once per atom
+//  at the start of the run and then multiply by exp(2PI i z) per step; false if memory runs out
+static bool sf_scalar(const SFAtoms *atoms, const HKL *hkl, const Vec3 *q, size_t n, double *intensity, double *friedel) {
+    size_t n_atoms = atoms->n;
+
+    // Per-atom step along l, and the running phase of each atom in the current run
+    double complex *step = malloc(2 * (n_atoms ? n_atoms : 1) * sizeof(*step));
+
+    // Debye-Waller factor T of each atom in the current run, its ratio R to the next l, and R's ratio K
+    double *T = malloc(3 * (n_atoms ? n_atoms : 1) * sizeof(*T));
+    if (!step || !T) {
+        free(step);
+        free(T);
+        return false;
+    }
+    double complex *phase = step + n_atoms;
+    for (size_t j = 0; j < n_atoms; j++) { step[j] = cexp(2 * PI * I * atoms->z[j]); }
+
+    double *R = T + n_atoms, *K = R + n_atoms;
+    for (size_t j = 0; j < n_atoms; j++) { K[j] = exp(-2 * atoms->w33[j]); }
+
+    double f_re[FF_MAX_ELEMENTS], f_im[FF_MAX_ELEMENTS];
+    sf_dispersion(atoms, f_im);
+
+    size_t i = 0;
+    while (i < n) {
+        // Run [i, end): same (h,k), l increasing by one
+        HKL start = hkl[i];
+        size_t end = i + 1;
+        while (end < n && hkl[end].h == start.h && hkl[end].k == start.k && hkl[end].l == hkl[end - 1].l + 1) {
+            end++;
+        }
+
+        for (size_t j = 0; j < n_atoms; j++) {
+            double t = start.h * atoms->x[j] + start.k * atoms->y[j] + start.l * atoms->z[j];
+            phase[j] = cexp(2 * PI * I * t);
+        }
+
+        // M(l) = w33 l^2 + 2 (w13 h + w23 k) l + (w11 h^2 + 2 w12 h k + w22 k^2), so T(l+1) / T(l) = exp(-(M(l+1) - M(l)))
+        if (atoms->thermal) {
+            for (size_t j = 0; j < n_atoms; j++) {
+                double h = start.h, k = start.k, l = start.l;
+                double lin = 2 * (atoms->w13[j] * h + atoms->w23[j] * k);
+                double M = atoms->w11[j] * h * h + atoms->w22[j] * k * k + 2 * atoms->w12[j] * h * k + (atoms->w33[j] * l + lin) * l;
+                T[j] = exp(-M);
+                R[j] = exp(-(atoms->w33[j] * (2 * l + 1) + lin));
+            }
+        }
+
+        for (size_t r = i; r < end; r++) {
+            sf_form_factors(atoms, q[r], f_re);
+
+            double A = 0, B = 0, C = 0, D = 0;
+            for (size_t e = 0; e < atoms->n_groups; e++) {
+                double complex sum = 0;
+                for (size_t j = atoms->group[e]; j < atoms->group[e + 1]; j++) {
+                    if (atoms->thermal) {
+                        sum += atoms->f[j] * T[j] * phase[j];
+                        T[j] *= R[j];
+                        R[j] *= K[j];
+                    }
+                    else { sum += atoms->f[j] * phase[j]; }
+                    phase[j] *= step[j];
+                }
+                A += f_re[e] * creal(sum);
+                B += f_im[e] * cimag(sum);
+                C += f_re[e] * cimag(sum);
+                D += f_im[e] * creal(sum);
+            }
+
+            // One Newton step towards |phase| = 1 keeps the round-off drift bounded
+            if ((r - i) % SF_RENORM == SF_RENORM - 1) {
+                for (size_t j = 0; j < n_atoms; j++) {
+                    double m2 = creal(phase[j]) * creal(phase[j]) + cimag(phase[j]) * cimag(phase[j]);
+                    phase[j] *= 0.5 * (3.0 - m2);
+                }
+            }
+
+            intensity[r] = sf_friedel_pair(A, B, C, D, friedel ? &friedel[r] : NULL);
+        }
+
+        i = end;
+    }
+
+    free(step);
+    free(T);
+    return true;
+}
+
+
+// VECTOR KERNELS ----------------- //
+
+#if defined(SF_X86)
+
+#define SF_KERNEL_NAME sf_sse2
+#define SF_KERNEL_TARGET __attribute__((target("sse2")))
+#define SF_W 2
+#include "sf_kernel.h"
+#undef SF_KERNEL_NAME
+#undef SF_KERNEL_TARGET
+#undef SF_W
+
+#define SF_KERNEL_NAME sf_avx2
+#define SF_KERNEL_TARGET __attribute__((target("avx2,fma")))
+#define SF_W 4
+#include "sf_kernel.h"
+#undef SF_KERNEL_NAME
+#undef SF_KERNEL_TARGET
+#undef SF_W
+
+#define SF_KERNEL_NAME sf_avx512
+#define SF_KERNEL_TARGET __attribute__((target("avx512f")))
+#define SF_W 8
+#include "sf_kernel.h"
+#undef SF_KERNEL_NAME
+#undef SF_KERNEL_TARGET
+#undef SF_W
+
+#endif
+
+
+typedef bool (*SFKernel)(const SFAtoms *atoms, const HKL *hkl, const Vec3 *q, size_t n, double *intensity, double *friedel);
+
+static SFPath sf_path = SF_PATH_AUTO;
+static SFKernel sf_kernel = NULL;
+
+
+// Use the given path (SF_PATH_AUTO = widest one the CPU supports); false if the CPU cannot run it
+bool sf_engine_select(SFPath path) {
+    if (path == SF_PATH_AUTO) { path = (SFPath)math_path_widest(); }
+    if (!math_path_supported((MathPath)path)) { return false; }
+
+    switch (path) {
+#if defined(SF_X86)
+        case SF_PATH_SSE2:   sf_kernel = sf_sse2; break;
+        case SF_PATH_AVX2:   sf_kernel = sf_avx2; break;
+        case SF_PATH_AVX512: sf_kernel = sf_avx512; break;
+#endif
+        default:             sf_kernel = sf_scalar; break;
+    }
+    sf_path = path;
+
+    return true;
+}
+
+
+SFPath sf_engine_path(void) {
+    if (!sf_kernel) { sf_engine_select(SF_PATH_AUTO); }
+    return sf_path;
+}
+
+
+const char *sf_engine_name(SFPath path) {
+    return math_path_name((MathPath)path);
+}
+
+
+// |F|^2 of n reflections with scattering vectors q (for the form factors); matches the scalar path
+//  within SF_TOLERANCE * (sum |f|)^2. False if memory runs out (intensity is then left unspecified)
+bool sf_engine_run(const SFAtoms *atoms, const HKL *hkl, const Vec3 *q, size_t n, double *intensity) {
+    if (!atoms || !hkl || !q || !intensity) { return false; }
+
+    if (!sf_kernel) { sf_engine_select(SF_PATH_AUTO); }
+    return sf_kernel(atoms, hkl, q, n, intensity, NULL);
+}
+
+
+// As sf_engine_run, and |F(-h-k-l)|^2 of each reflection into friedel from the same per-element sums
+//  (the two differ once the form factors carry an anomalous f'')
+bool sf_engine_run_friedel(const SFAtoms *atoms, const HKL *hkl, const Vec3 *q, size_t n, double *intensity, double *friedel) {
+    if (!atoms || !hkl || !q || !intensity || !friedel) { return false; }
+
+    if (!sf_kernel) { sf_engine_select(SF_PATH_AUTO); }
+    return sf_kernel(atoms, hkl, q, n, intensity, friedel);
+}
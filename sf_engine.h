@@ -0,0 +1,53 @@
+#ifndef SF_ENGINE_H
+#define SF_ENGINE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "crystal.h"
+
+// Largest |I_vector - I_scalar| of any path, relative to (sum of |f|)^2 at the reflection: the vector paths start each
+//  row from a polynomial sincos (error ~1e-14) instead of cexp, then both follow the same recurrence
+#define SF_TOLERANCE 1e-9
+
+// Throughput target for the vector paths, in reflections * atoms per second (AVX2, one core, >= 8 atoms)
+#define SF_TARGET_RATE 1e9
+
+
+// STRUCTS ------------------------ //
+
+// The instruction sets of the math_helper batch kernels, probed by the same cpuid check
+typedef enum {
+    SF_PATH_AUTO = MATH_PATH_AUTO,
+    SF_PATH_SCALAR = MATH_PATH_SCALAR,
+    SF_PATH_SSE2 = MATH_PATH_SSE2,
+    SF_PATH_AVX2 = MATH_PATH_AVX2,
+    SF_PATH_AVX512 = MATH_PATH_AVX512
+} SFPath;
+
+
+
+Mat3 sf_displacement(const BasisAtoms *bas, size_t i, Mat3 B);
+
+
+bool sf_atoms_pack(SFAtoms *soa, const BasisAtoms *bas, Mat3 B);
+
+
+void sf_atoms_free(SFAtoms *soa);
+
+
+bool sf_engine_select(SFPath path);
+
+
+SFPath sf_engine_path(void);
+
+
+const char *sf_engine_name(SFPath path);
+
+
+bool sf_engine_run(const SFAtoms *atoms, const HKL *hkl, const Vec3 *q, size_t n, double *intensity);
+
+
+bool sf_engine_run_friedel(const SFAtoms *atoms, const HKL *hkl, const Vec3 *q, size_t n, double *intensity, double *friedel);
+
+
+#endif
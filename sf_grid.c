@@ -0,0 +1,312 @@
+/****************************************************************************************
+ * sf_grid.c
+ *
+ * Structure factors of large cells by FFT: every F(hkl) of the reflection box from one
+ *  3D transform of the atoms spread onto a fractional-coordinate grid
+ *  - Each atom becomes a Gaussian on the grid whose transform is exp(-h^T (D + W) h): D is
+ *    a fixed diagonal spreading width, W the atom's Debye-Waller exponent, so thermal
+ *    motion costs nothing extra; dividing the transform by exp(-h^T D h) undoes D
+ *  - D is as narrow as accuracy allows: the aliased images of the box, N - hmax away on a grid
+ *    of N points, are damped by exp(-L), as are the dropped Gaussian tails; undoing D then
+ *    amplifies them by up to exp(L (hmax / (N - hmax))^2), so L is picked to leave exp(-SF_GRID_ACCURACY)
+ *  - The grid oversamples the index box by SF_GRID_OVERSAMPLE, or SF_GRID_OVERSAMPLE_MIN (wider
+ *    Gaussians, a third of the memory) when the first would not fit in SF_GRID_MAX_CELLS
+ *  - Gaussians are quadratic exponents, so along a grid line they advance by two multiplies
+ *    per point (the Debye-Waller recurrence of sf_engine.c)
+ *  - Elements are spread separately (f(s) is applied per reflection), two per complex grid:
+ *    the real densities of a pair split again by Hermitian symmetry after the transform
+ *
+ ****************************************************************************************/
+
+
+#include "sf_grid.h"
+
+#include <stdlib.h>
+#include <math.h>
+#include <complex.h>
+
+#include "fft.h"
+
+
+// STRUCTS ------------------------ //
+
+typedef struct {
+    int hmax[3];        // index box of the reflections
+    size_t N[3];        // grid points per axis
+    double decay;       // L: Gaussians are cut, and aliases damped, at exp(-L)
+    double tau[3];      // spreading width D = diag(tau)
+} SFGridShape;
+
+
+typedef struct {
+    size_t key;         // grid tile of the atom in the (x, y) plane
+    size_t slot;
+} SFGridOrder;
+
+
+
+// Grid for the reflections' index box, the finer oversampling first; false if neither fits
+static bool sf_grid_shape(const HKL *hkl, size_t n, SFGridShape *shape) {
+    int *hmax = shape->hmax;
+    hmax[0] = hmax[1] = hmax[2] = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (abs(hkl[i].h) > hmax[0]) { hmax[0] = abs(hkl[i].h); }
+        if (abs(hkl[i].k) > hmax[1]) { hmax[1] = abs(hkl[i].k); }
+        if (abs(hkl[i].l) > hmax[2]) { hmax[2] = abs(hkl[i].l); }
+    }
+
+    const double oversample[] = { SF_GRID_OVERSAMPLE, SF_GRID_OVERSAMPLE_MIN };
+    for (int o = 0; o < 2; o++) {
+        double cells = 1, rho = 0;
+        for (int a = 0; a < 3; a++) {
+            shape->N[a] = fft_good_size((size_t)ceil(oversample[o] * (2 * hmax[a] + 1)));
+            cells *= (double)shape->N[a];
+
+            double r = hmax[a] / (double)(shape->N[a] - hmax[a]);
+            if (r > rho) { rho = r; }
+        }
+        if (cells > (double)SF_GRID_MAX_CELLS) { continue; }
+
+        shape->decay = SF_GRID_ACCURACY / (1 - rho * rho);
+        for (int a = 0; a < 3; a++) { shape->tau[a] = shape->decay / ((shape->N[a] - hmax[a]) * (double)(shape->N[a] - hmax[a])); }
+        return true;
+    }
+
+    return false;
+}
+
+
+// Is one FFT (per pair of elements) for the n reflections cheaper than the direct sum over n_direct of them
+//  (fewer when symmetry spares the rest) and every atom? Estimated from the operation counts of both
+bool sf_grid_preferred(const SFAtoms *atoms, const HKL *hkl, size_t n, size_t n_direct) {
+    if (!atoms || !hkl || atoms->n == 0 || n == 0) { return false; }
+
+    SFGridShape shape;
+    if (!sf_grid_shape(hkl, n, &shape)) { return false; }
+
+    // Atom j covers the ellipsoid exp(-E) > exp(-L), half-widths sqrt(L (tau + W_aa)) N / PI
+    double spread = 0;
+    for (size_t j = 0; j < atoms->cap; j++) {
+        if (atoms->f[j] == 0) { continue; }
+
+        double w[3] = { atoms->w11[j], atoms->w22[j], atoms->w33[j] };
+        double points = 4.0 / 3 * PI;
+        for (int a = 0; a < 3; a++) { points *= sqrt(shape.decay * (shape.tau[a] + w[a])) * shape.N[a] / PI + 0.5; }
+        spread += points;
+    }
+
+    double cells = (double)shape.N[0] * shape.N[1] * shape.N[2];
+    double pairs = (double)((atoms->n_groups + 1) / 2);
+    double direct = (double)n_direct * atoms->cap;
+    double grid = SF_GRID_COST_SPREAD * spread + SF_GRID_COST_FFT * pairs * cells * log2(cells) + (double)n * atoms->n_groups;
+
+    return grid < direct;
+}
+
+
+// Inverse of the symmetric positive-definite 3x3 matrix S into P; returns det(P), 0 if S is singular
+static double sf_grid_inverse(const double S[3][3], double P[3][3]) {
+    double c00 = S[1][1] * S[2][2] - S[1][2] * S[2][1];
+    double c01 = S[1][2] * S[2][0] - S[1][0] * S[2][2];
+    double c02 = S[1][0] * S[2][1] - S[1][1] * S[2][0];
+    double det = S[0][0] * c00 + S[0][1] * c01 + S[0][2] * c02;
+    if (!(det > 0)) { return 0; }
+
+    P[0][0] = c00 / det;
+    P[0][1] = P[1][0] = c01 / det;
+    P[0][2] = P[2][0] = c02 / det;
+    P[1][1] = (S[0][0] * S[2][2] - S[0][2] * S[2][0]) / det;
+    P[1][2] = P[2][1] = (S[0][2] * S[1][0] - S[0][0] * S[1][2]) / det;
+    P[2][2] = (S[0][0] * S[1][1] - S[0][1] * S[1][0]) / det;
+
+    return 1 / det;
+}
+
+
+// Add slot j's Gaussian to part (0 real, 1 imaginary) of the grid; false if it is wider than the grid
+//  With u the offset from the atom in fractional coordinates, the density is norm exp(-u^T P u),
+//  P = PI^2 (D + W)^-1, whose transform is exp(-h^T (D + W) h) (norm makes it 1 at h = 0)
+static bool sf_grid_spread(const SFAtoms *atoms, size_t j, const SFGridShape *shape, double *grid, int part) {
+    const size_t *N = shape->N;
+    const double *tau = shape->tau;
+    double L = shape->decay;
+
+    double S[3][3] = {
+        { tau[0] + atoms->w11[j], atoms->w12[j],          atoms->w13[j] },
+        { atoms->w12[j],          tau[1] + atoms->w22[j], atoms->w23[j] },
+        { atoms->w13[j],          atoms->w23[j],          tau[2] + atoms->w33[j] },
+    };
+    double P[3][3];
+    double det = sf_grid_inverse(S, P);
+    if (det == 0) { return false; }
+    for (int a = 0; a < 3; a++) {
+        for (int b = 0; b < 3; b++) { P[a][b] *= PI * PI; }
+    }
+    det *= PI * PI * PI * PI * PI * PI;
+    double norm = atoms->f[j] * sqrt(det / (PI * PI * PI)) / ((double)N[0] * N[1] * N[2]);
+
+    // Nearest grid point c and the atom's offset o from it (in grid steps), per axis
+    double x[3] = { atoms->x[j], atoms->y[j], atoms->z[j] };
+    long c[3], reach[3];
+    double o[3];
+    for (int a = 0; a < 3; a++) {
+        double g = x[a] * N[a];
+        double nearest = floor(g + 0.5);
+        o[a] = nearest - g;
+        c[a] = (long)(nearest - floor(nearest / N[a]) * N[a]);
+
+        // Bounding box of u^T P u <= L: half-width sqrt(L (P^-1)_aa)
+        reach[a] = (long)ceil(sqrt(L * S[a][a]) / PI * N[a]);
+        if (2 * reach[a] + 1 > (long)N[a]) { return false; }
+    }
+
+    double step = 1.0 / N[2];
+    double K = exp(-2 * P[2][2] * step * step);
+    for (long d0 = -reach[0]; d0 <= reach[0]; d0++) {
+        double u0 = (d0 + o[0]) / N[0];
+        size_t i0 = (size_t)((c[0] + d0 + (long)N[0]) % (long)N[0]);
+
+        for (long d1 = -reach[1]; d1 <= reach[1]; d1++) {
+            double u1 = (d1 + o[1]) / N[1];
+            size_t i1 = (size_t)((c[1] + d1 + (long)N[1]) % (long)N[1]);
+
+            // E(u2) = P22 u2^2 + 2 b u2 + e0 <= L on the chord [lo, hi] of this line
+            double b = P[0][2] * u0 + P[1][2] * u1;
+            double e0 = P[0][0] * u0 * u0 + P[1][1] * u1 * u1 + 2 * P[0][1] * u0 * u1;
+            double disc = b * b - P[2][2] * (e0 - L);
+            if (disc < 0) { continue; }
+
+            double root = sqrt(disc);
+            long lo = (long)ceil((-b - root) / P[2][2] * N[2] - o[2]);
+            long hi = (long)floor((-b + root) / P[2][2] * N[2] - o[2]);
+            if (hi < lo) { continue; }
+
+            double u2 = (lo + o[2]) * step;
+            double T = norm * exp(-(P[2][2] * u2 * u2 + 2 * b * u2 + e0));
+            double R = exp(-(P[2][2] * (2 * u2 + step) + 2 * b) * step);
+
+            double *line = grid + 2 * (i0 * N[1] + i1) * N[2] + part;
+            size_t i2 = (size_t)((c[2] + lo + (long)N[2]) % (long)N[2]);
+            for (long d2 = lo; d2 <= hi; d2++) {
+                line[2 * i2] += T;
+                T *= R;
+                R *= K;
+                if (++i2 == N[2]) { i2 = 0; }
+            }
+        }
+    }
+
+    return true;
+}
+
+
+static int sf_grid_order_cmp(const void *a, const void *b) {
+    size_t ka = ((const SFGridOrder *)a)->key, kb = ((const SFGridOrder *)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+
+// Slots of each element sorted by their SF_GRID_TILE x SF_GRID_TILE tile of grid lines, so atoms spread one
+//  after another mostly write to lines already in cache; NULL if memory runs out
+static SFGridOrder *sf_grid_order(const SFAtoms *atoms, const size_t N[3]) {
+    SFGridOrder *order = malloc((atoms->cap ? atoms->cap : 1) * sizeof(*order));
+    if (!order) { return NULL; }
+
+    size_t tiles1 = N[1] / SF_GRID_TILE + 1;
+    for (size_t j = 0; j < atoms->cap; j++) {
+        double x = atoms->x[j] - floor(atoms->x[j]), y = atoms->y[j] - floor(atoms->y[j]);
+        size_t t0 = (size_t)(x * N[0]) / SF_GRID_TILE, t1 = (size_t)(y * N[1]) / SF_GRID_TILE;
+        order[j] = (SFGridOrder){ t0 * tiles1 + t1, j };
+    }
+    for (size_t e = 0; e < atoms->n_groups; e++) {
+        qsort(order + atoms->group[e], atoms->group[e + 1] - atoms->group[e], sizeof(*order), sf_grid_order_cmp);
+    }
+
+    return order;
+}
+
+
+// Grid index of Miller index h along an axis of N points
+static inline size_t sf_grid_wrap(int h, size_t N) {
+    return h < 0 ? (size_t)(h + (long)N) : (size_t)h;
+}
+
+
+// |F|^2 of n reflections (q for the form factors) from the FFT of the gridded atoms; false if the grid
+//  would be too large, an atom is wider than it, or memory runs out (intensity is then untouched)
+bool sf_grid_run(const SFAtoms *atoms, const HKL *hkl, const Vec3 *q, size_t n, double *intensity) {
+    if (!atoms || !hkl || !q || !intensity) { return false; }
+
+    SFGridShape shape;
+    if (!sf_grid_shape(hkl, n, &shape)) { return false; }
+    const size_t *N = shape.N;
+    const int *hmax = shape.hmax;
+    size_t cells = N[0] * N[1] * N[2];
+
+    FFTPlan plan[3] = {0};
+    double complex *grid = malloc(cells * sizeof(*grid));
+    double complex *F = calloc(n ? n : 1, sizeof(*F));
+    SFGridOrder *order = sf_grid_order(atoms, N);
+
+    // exp(tau_a h^2) per axis, the deconvolution of the spreading width
+    double *undo[3] = {0};
+    bool ok = grid && F && order;
+    for (int a = 0; a < 3; a++) {
+        ok = ok && fft_plan_init(&plan[a], N[a], 1);
+        undo[a] = malloc((2 * hmax[a] + 1) * sizeof(*undo[a]));
+        ok = ok && undo[a];
+        for (int h = -hmax[a]; ok && h <= hmax[a]; h++) { undo[a][h + hmax[a]] = exp(shape.tau[a] * h * h); }
+    }
+
+    const FFTables *ff = atoms->ff;
+    bool tables = ff && ff->n > 0;
+
+    for (size_t e = 0; ok && e < atoms->n_groups; e += 2) {
+        for (size_t i = 0; i < cells; i++) { grid[i] = 0; }
+
+        // Element e into the real part, e + 1 (if any) into the imaginary part
+        for (size_t p = 0; ok && p < 2 && e + p < atoms->n_groups; p++) {
+            for (size_t i = atoms->group[e + p]; ok && i < atoms->group[e + p + 1]; i++) {
+                size_t j = order[i].slot;
+                if (atoms->f[j] != 0) { ok = sf_grid_spread(atoms, j, &shape, (double *)grid, (int)p); }
+            }
+        }
+        if (!ok) { break; }
+
+        fft_3d(plan, grid);
+
+        // X = G_e + i G_e+1 with G real in space: G_e(h) = (X(h) + X(-h)*) / 2, G_e+1(h) = (X(h) - X(-h)*) / 2i
+        bool pair = e + 1 < atoms->n_groups;
+        for (size_t r = 0; r < n; r++) {
+            HKL p = hkl[r];
+            double complex X = grid[(sf_grid_wrap(p.h, N[0]) * N[1] + sf_grid_wrap(p.k, N[1])) * N[2] + sf_grid_wrap(p.l, N[2])];
+            double complex Xm = grid[(sf_grid_wrap(-p.h, N[0]) * N[1] + sf_grid_wrap(-p.k, N[1])) * N[2] + sf_grid_wrap(-p.l, N[2])];
+            double scale = undo[0][p.h + hmax[0]] * undo[1][p.k + hmax[1]] * undo[2][p.l + hmax[2]];
+
+            double s = v3_magnitude(q[r]) / (4 * PI);
+            double complex Ge = 0.5 * (X + conj(Xm));
+            double complex f = tables ? CMPLX(ff_lookup(ff, e, s) + ff->fp[e], ff->fpp[e]) : 1;
+            double complex sum = CMPLX(creal(f) * creal(Ge) - cimag(f) * cimag(Ge), creal(f) * cimag(Ge) + cimag(f) * creal(Ge));
+            if (pair) {
+                double complex d = X - conj(Xm);
+                double complex Go = CMPLX(0.5 * cimag(d), -0.5 * creal(d));
+                double complex g = tables ? CMPLX(ff_lookup(ff, e + 1, s) + ff->fp[e + 1], ff->fpp[e + 1]) : 1;
+                sum += CMPLX(creal(g) * creal(Go) - cimag(g) * cimag(Go), creal(g) * cimag(Go) + cimag(g) * creal(Go));
+            }
+            F[r] += scale * sum;
+        }
+    }
+
+    if (ok) {
+        for (size_t r = 0; r < n; r++) { intensity[r] = creal(F[r]) * creal(F[r]) + cimag(F[r]) * cimag(F[r]); }
+    }
+
+    for (int a = 0; a < 3; a++) {
+        fft_plan_free(&plan[a]);
+        free(undo[a]);
+    }
+    free(grid);
+    free(F);
+    free(order);
+    return ok;
+}
@@ -0,0 +1,26 @@
+#ifndef SF_GRID_H
+#define SF_GRID_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "crystal.h"
+
+#define SF_GRID_OVERSAMPLE 2.0      // grid points per index of the reflection box, along each axis
+#define SF_GRID_OVERSAMPLE_MIN 1.5  // fallback for boxes whose finer grid would not fit
+#define SF_GRID_ACCURACY 21.5       // -ln of the error in F relative to sum |f| (~5e-10, inside SF_TOLERANCE for |F|^2)
+#define SF_GRID_MAX_CELLS ((size_t)1 << 24)     // largest grid (16 bytes per cell) before direct summation is kept
+#define SF_GRID_TILE 8              // grid lines per side of the tiles atoms are spread in
+
+// Relative costs against one reflection * atom term of the vector direct sum
+#define SF_GRID_COST_SPREAD 8.0     // per grid point an atom is spread onto
+#define SF_GRID_COST_FFT 3.0        // per grid cell and log2 of the cell count, for each pair of elements
+
+
+
+bool sf_grid_preferred(const SFAtoms *atoms, const HKL *hkl, size_t n, size_t n_direct);
+
+
+bool sf_grid_run(const SFAtoms *atoms, const HKL *hkl, const Vec3 *q, size_t n, double *intensity);
+
+
+#endif
@@ -0,0 +1,192 @@
+/****************************************************************************************
+ * sf_kernel.h
+ *
+ * Vector structure-factor kernel body, included by sf_engine.c once per instruction set
+ *  (no include guard) with SF_KERNEL_NAME, SF_KERNEL_TARGET and SF_W (doubles per vector) defined
+ *  - Lanes are atoms (the SoA arrays are padded with f = 0 atoms to a whole number of vectors);
+ *    a vector never mixes elements, so each element's cos/sin sums are weighted by its form factor
+ *    as whole vectors and reduced across lanes once per reflection
+ *  - Same recurrence as the scalar path: at the start of each hkl row the phases come from a
+ *    polynomial sincos, then every step along l is one complex multiply per lane
+ *  - Phases are kept in turns t = hx + ky + lz, so range reduction is exact: t = q/4 + y with
+ *    q = round(4t), |y| <= 1/8; the quadrant q rotates (cos, sin) with bit masks
+ *  - Debye-Waller factors follow the scalar recurrence (T *= R, R *= K along l); the exponentials
+ *    at row starts use a polynomial exp, and atoms at rest take a loop without them
+ *
+ ****************************************************************************************/
+
+
+SF_KERNEL_TARGET
+static bool SF_KERNEL_NAME(const SFAtoms *atoms, const HKL *hkl, const Vec3 *q, size_t n, double *intensity, double *friedel) {
+    typedef double vd __attribute__((vector_size(SF_W * sizeof(double))));
+    typedef unsigned long long vu __attribute__((vector_size(SF_W * sizeof(double))));
+
+    // Adding 1.5 * 2^52 rounds to an integer, which then sits in the low mantissa bits
+    const double magic = 6755399441055744.0;
+
+    size_t n_vec = (atoms->n + SF_W - 1) / SF_W;
+    if (n_vec == 0) {
+        for (size_t i = 0; i < n; i++) { intensity[i] = 0; }
+        if (friedel) { for (size_t i = 0; i < n; i++) { friedel[i] = 0; } }
+        return true;
+    }
+
+    // Scratch: running phase (re, im), per-step rotation (re, im) and Debye-Waller T, R, K of every atom vector
+    vd *scratch = sf_alloc(7 * n_vec * sizeof(vd));
+    if (!scratch) { return false; }
+    vd *pr = scratch, *pi = pr + n_vec, *sr = pi + n_vec, *si = sr + n_vec;
+    vd *tv = si + n_vec, *rv = tv + n_vec, *kv = rv + n_vec;
+
+    const vd *x = (const vd *)atoms->x;
+    const vd *y = (const vd *)atoms->y;
+    const vd *z = (const vd *)atoms->z;
+    const vd *f = (const vd *)atoms->f;
+    double f_re[FF_MAX_ELEMENTS], f_im[FF_MAX_ELEMENTS];
+    sf_dispersion(atoms, f_im);
+
+    // Vector range of each element group (every group but the last starts on a cache line)
+    size_t v_lo[FF_MAX_ELEMENTS], v_hi[FF_MAX_ELEMENTS];
+    for (size_t e = 0; e < atoms->n_groups; e++) {
+        v_lo[e] = atoms->group[e] / SF_W;
+        v_hi[e] = (atoms->group[e + 1] + SF_W - 1) / SF_W;
+    }
+
+// cos/sin(2PI t) of a vector of phases in turns
+#define SF_SINCOS(t, c_out, s_out) do {                                                                         \
+        vd q4_ = (t) * 4.0 + magic;                                                                             \
+        vu quad_ = (vu)q4_;                                                                                     \
+        vd ang_ = ((t) - (q4_ - magic) * 0.25) * (2 * PI);                                                      \
+        vd ang2_ = ang_ * ang_;                                                                                 \
+        vd s_ = ang_ * (1 + ang2_ * (-1.0 / 6 + ang2_ * (1.0 / 120 + ang2_ * (-1.0 / 5040 + ang2_ * (1.0 / 362880 +\
+                    ang2_ * (-1.0 / 39916800 + ang2_ * (1.0 / 6227020800.0)))))));                              \
+        vd c_ = 1 + ang2_ * (-0.5 + ang2_ * (1.0 / 24 + ang2_ * (-1.0 / 720 + ang2_ * (1.0 / 40320 +            \
+                    ang2_ * (-1.0 / 3628800 + ang2_ * (1.0 / 479001600 + ang2_ * (-1.0 / 87178291200.0)))))));  \
+        /* odd q swaps the pair, then q = 1,2 negate cos and q = 2,3 negate sin */                              \
+        vu odd_ = -(quad_ & 1);                                                                                 \
+        vu cb_ = (vu)c_, sb_ = (vu)s_;                                                                          \
+        (c_out) = (vd)(((cb_ & ~odd_) | (sb_ & odd_)) ^ (((quad_ + 1) & 2) << 62));                             \
+        (s_out) = (vd)(((sb_ & ~odd_) | (cb_ & odd_)) ^ ((quad_ & 2) << 62));                                   \
+    } while (0)
+
+// exp(x) of a vector: x = n ln2 + r with |r| <= ln2 / 2 (ln2 split in two so n ln2 is exact), e^r by
+//  its Taylor series and 2^n built in the exponent bits; x is clamped to the finite double range
+#define SF_EXP(x, e_out) do {                                                                                   \
+        vd x_ = (x);                                                                                            \
+        vu lo_ = (vu)(x_ < -708.0), hi_ = (vu)(x_ > 708.0);                                                     \
+        x_ = (vd)(((vu)x_ & ~(lo_ | hi_)) | ((vu)((vd){0} - 708.0) & lo_) | ((vu)((vd){0} + 708.0) & hi_));     \
+        vd n_ = x_ * 1.4426950408889634 + magic;                                                                \
+        vu ni_ = (vu)n_;                                                                                        \
+        n_ -= magic;                                                                                            \
+        vd r_ = (x_ - n_ * 6.93147180369123816490e-01) - n_ * 1.90821492927058770002e-10;                       \
+        vd p_ = 1 + r_ * (1 + r_ * (1.0 / 2 + r_ * (1.0 / 6 + r_ * (1.0 / 24 + r_ * (1.0 / 120 + r_ * (1.0 / 720 +\
+                    r_ * (1.0 / 5040 + r_ * (1.0 / 40320 + r_ * (1.0 / 362880 + r_ * (1.0 / 3628800 +          \
+                    r_ * (1.0 / 39916800 + r_ * (1.0 / 479001600.0))))))))))));                                 \
+        /* the low mantissa bits of n_ hold n in two's complement, so adding the bias wraps correctly */      \
+        (e_out) = p_ * (vd)(((ni_ + 1023) & 0x7ff) << 52);                                                      \
+    } while (0)
+
+    const vd *w11 = (const vd *)atoms->w11, *w22 = (const vd *)atoms->w22, *w33 = (const vd *)atoms->w33;
+    const vd *w12 = (const vd *)atoms->w12, *w13 = (const vd *)atoms->w13, *w23 = (const vd *)atoms->w23;
+
+    for (size_t a = 0; a < n_vec; a++) { SF_SINCOS(z[a], sr[a], si[a]); }
+    if (atoms->thermal) {
+        for (size_t a = 0; a < n_vec; a++) { SF_EXP(-2.0 * w33[a], kv[a]); }
+    }
+
+    size_t i = 0;
+    while (i < n) {
+        // Run [i, end): same (h,k), l increasing by one
+        HKL start = hkl[i];
+        size_t end = i + 1;
+        while (end < n && hkl[end].h == start.h && hkl[end].k == start.k && hkl[end].l == hkl[end - 1].l + 1) {
+            end++;
+        }
+
+        for (size_t a = 0; a < n_vec; a++) {
+            vd t = x[a] * (double)start.h + y[a] * (double)start.k + z[a] * (double)start.l;
+            SF_SINCOS(t, pr[a], pi[a]);
+        }
+
+        // T = exp(-M(l)) and R = T(l+1) / T(l), with M(l) = w33 l^2 + 2 (w13 h + w23 k) l + (w11 h^2 + 2 w12 h k + w22 k^2)
+        if (atoms->thermal) {
+            double h = start.h, k = start.k, l = start.l;
+            for (size_t a = 0; a < n_vec; a++) {
+                vd lin = 2.0 * (w13[a] * h + w23[a] * k);
+                vd M = w11[a] * (h * h) + w22[a] * (k * k) + w12[a] * (2 * h * k) + (w33[a] * l + lin) * l;
+                SF_EXP(-M, tv[a]);
+                SF_EXP(-(w33[a] * (2 * l + 1) + lin), rv[a]);
+            }
+        }
+
+        for (size_t r = i; r < end; r++) {
+            sf_form_factors(atoms, q[r], f_re);
+
+            vd A = {0}, B = {0}, C = {0}, D = {0};
+            for (size_t e = 0; e < atoms->n_groups; e++) {
+                vd re = {0}, im = {0};
+                if (atoms->thermal) {
+                    for (size_t a = v_lo[e]; a < v_hi[e]; a++) {
+                        vd w = f[a] * tv[a];
+                        re += w * pr[a];
+                        im += w * pi[a];
+                        tv[a] *= rv[a];
+                        rv[a] *= kv[a];
+                        vd nr = pr[a] * sr[a] - pi[a] * si[a];
+                        pi[a] = pr[a] * si[a] + pi[a] * sr[a];
+                        pr[a] = nr;
+                    }
+                }
+                else {
+                    for (size_t a = v_lo[e]; a < v_hi[e]; a++) {
+                        re += f[a] * pr[a];
+                        im += f[a] * pi[a];
+                        vd nr = pr[a] * sr[a] - pi[a] * si[a];
+                        pi[a] = pr[a] * si[a] + pi[a] * sr[a];
+                        pr[a] = nr;
+                    }
+                }
+
+                A += f_re[e] * re;
+                B += f_im[e] * im;
+                C += f_re[e] * im;
+                D += f_im[e] * re;
+            }
+
+            // One Newton step towards |phase| = 1 keeps the round-off drift bounded
+            if ((r - i) % SF_RENORM == SF_RENORM - 1) {
+                for (size_t a = 0; a < n_vec; a++) {
+                    vd g = 0.5 * (3.0 - (pr[a] * pr[a] + pi[a] * pi[a]));
+                    pr[a] *= g;
+                    pi[a] *= g;
+                }
+            }
+
+            // F(h) = (A - B) + i (C + D) lane-wise; the mate F(-h) = (A + B) + i (D - C) only when asked for
+            vd F_re = A - B, F_im = C + D;
+            double re_sum = 0, im_sum = 0;
+            for (size_t j = 0; j < SF_W; j++) {
+                re_sum += F_re[j];
+                im_sum += F_im[j];
+            }
+            intensity[r] = re_sum * re_sum + im_sum * im_sum;
+
+            if (friedel) {
+                vd M_re = A + B, M_im = D - C;
+                re_sum = im_sum = 0;
+                for (size_t j = 0; j < SF_W; j++) {
+                    re_sum += M_re[j];
+                    im_sum += M_im[j];
+                }
+                friedel[r] = re_sum * re_sum + im_sum * im_sum;
+            }
+        }
+
+        i = end;
+    }
+
+#undef SF_SINCOS
+#undef SF_EXP
+
+    sf_free(scratch);
+    return true;
+}
@@ -0,0 +1,164 @@
+/****************************************************************************************
+ * sf_memo.c
+ *
+ * Memo of structure factors across passes, keyed by a fingerprint of everything |F|^2
+ *  depends on besides (h,k,l)
+ *  - The fingerprint hashes the atom positions, elements and displacements, the reciprocal
+ *    basis (|q| for f(s), the Debye-Waller exponents) and, with anomalous dispersion, the
+ *    wavelength; without dispersion |F|^2 does not depend on the radiation at all
+ *  - Open addressing with linear probing over at most SF_MEMO_PROBES slots; slots are never
+ *    emptied one by one, so a lookup stops at the first empty slot
+ *  - A full probe window evicts its least recently used entry, by the clock stamped on
+ *    every lookup and store (one tick per pass)
+ *  - The table grows to twice the cache it serves, so a cache and the cell it is toggled
+ *    with fit side by side; growing starts it over empty, in a new table carved from the
+ *    crystal's long-lived arena (the doublings left behind add up to less than the last)
+ *  - The last SF_MEMO_BASES fingerprints stored are remembered, so a pass over a basis the
+ *    table has never seen skips straight to summing
+ *
+ ****************************************************************************************/
+
+
+#include "sf_memo.h"
+
+#include <string.h>
+
+
+// METHODS ------------------------ //
+
+static inline uint64_t sf_memo_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+
+// Fold n bytes into a running hash, one 64-bit word at a time
+static uint64_t sf_memo_hash(uint64_t h, const void *data, size_t n) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < n; i += sizeof(uint64_t)) {
+        uint64_t w = 0;
+        memcpy(&w, bytes + i, n - i < sizeof(w) ? n - i : sizeof(w));
+        h = sf_memo_mix(h ^ w) + i;
+    }
+    return h;
+}
+
+
+// First slot of a reflection's probe window: rows of consecutive l fall into consecutive windows, so a pass
+//  over the cache in (h,k,l) order streams through the table instead of jumping once per reflection
+static inline size_t sf_memo_home(const SFMemo *memo, uint64_t basis, HKL p) {
+    uint64_t row = basis ^ ((uint64_t)(uint32_t)p.h * 0x9e3779b97f4a7c15ULL) ^ ((uint64_t)(uint32_t)p.k * 0xbf58476d1ce4e5b9ULL);
+    return (size_t)((sf_memo_mix(row) + (uint64_t)(int64_t)p.l) * SF_MEMO_PROBES) & (memo->cap - 1);
+}
+
+
+// Forget every entry (the counters are kept)
+void sf_memo_clear(SFMemo *memo) {
+    if (!memo || !memo->entries) { return; }
+
+    memset(memo->entries, 0, memo->cap * sizeof(*memo->entries));
+    memset(memo->bases, 0, sizeof(memo->bases));
+    memo->clock = 0;
+
+    return;
+}
+
+
+// Fingerprint of a basis on a lattice at a wavelength: equal fingerprints give equal |F(hkl)|^2 (never 0)
+uint64_t sf_memo_fingerprint(const BasisAtoms *bas, const Lattice *lattice, double wavelength) {
+    uint64_t h = sf_memo_hash(0x6a09e667f3bcc909ULL, &bas->n, sizeof(bas->n));
+    if (bas->n) {
+        h = sf_memo_hash(h, bas->pos, bas->n * sizeof(*bas->pos));
+        h = sf_memo_hash(h, bas->Biso, bas->n * sizeof(*bas->Biso));
+        h = sf_memo_hash(h, bas->U, bas->n * sizeof(*bas->U));
+        if (bas->Z) { h = sf_memo_hash(h, bas->Z, bas->n * sizeof(*bas->Z)); }
+    }
+    h = sf_memo_hash(h, &lattice->B, sizeof(lattice->B));
+
+    int anomalous = bas->anomalous;
+    h = sf_memo_hash(h, &anomalous, sizeof(anomalous));
+    if (bas->anomalous) { h = sf_memo_hash(h, &wavelength, sizeof(wavelength)); }
+
+    return h ? h : 1;
+}
+
+
+// Start a pass over n reflections: grow the table to at least 2n slots (within SF_MEMO_ENTRIES and
+//  SF_MEMO_MAX_ENTRIES), carved from the given arena, and advance the clock; false if memory runs out
+bool sf_memo_begin(SFMemo *memo, Arena *arena, size_t n) {
+    if (!memo) { return false; }
+
+    size_t cap = SF_MEMO_ENTRIES;
+    while (cap < SF_MEMO_MAX_ENTRIES && cap / 2 < n) { cap *= 2; }
+    if (!memo->entries || memo->cap < cap) {
+        SFMemoEntry *entries = arena_calloc(arena, cap, sizeof(*entries));
+        if (!entries) { return false; }
+        memo->entries = entries;
+        memo->cap = cap;
+        memset(memo->bases, 0, sizeof(memo->bases));
+    }
+    memo->clock++;
+
+    return true;
+}
+
+
+// Whether a basis fingerprint has been stored since the table last started over; remembers it either way,
+//  in place of the least recent of the last SF_MEMO_BASES
+bool sf_memo_seen(SFMemo *memo, uint64_t basis) {
+    for (size_t i = 0; i < SF_MEMO_BASES; i++) {
+        if (memo->bases[i] == basis) { return true; }
+    }
+    memo->bases[memo->next_base] = basis;
+    memo->next_base = (memo->next_base + 1) % SF_MEMO_BASES;
+
+    return false;
+}
+
+
+// |F|^2 of a reflection for a basis fingerprint into *intensity, if it was stored; counts a hit or a miss
+bool sf_memo_lookup(SFMemo *memo, uint64_t basis, HKL p, double *intensity) {
+    size_t mask = memo->cap - 1;
+    size_t slot = sf_memo_home(memo, basis, p);
+    for (size_t i = 0; i < SF_MEMO_PROBES; i++, slot = (slot + 1) & mask) {
+        SFMemoEntry *e = &memo->entries[slot];
+        if (e->basis == 0) { break; }
+        if (e->basis != basis || e->h != p.h || e->k != p.k || e->l != p.l) { continue; }
+
+        e->used = memo->clock;
+        *intensity = e->intensity;
+        memo->hits++;
+        return true;
+    }
+
+    memo->misses++;
+    return false;
+}
+
+
+// Store |F|^2 of a reflection: into its own entry or the first empty slot of its window, else over the
+//  window's least recently used entry
+void sf_memo_store(SFMemo *memo, uint64_t basis, HKL p, double intensity) {
+    size_t mask = memo->cap - 1;
+    size_t slot = sf_memo_home(memo, basis, p);
+    SFMemoEntry *victim = &memo->entries[slot];
+    for (size_t i = 0; i < SF_MEMO_PROBES; i++, slot = (slot + 1) & mask) {
+        SFMemoEntry *e = &memo->entries[slot];
+        if (e->basis == 0 || (e->basis == basis && e->h == p.h && e->k == p.k && e->l == p.l)) {
+            victim = e;
+            break;
+        }
+        if (e->used < victim->used) { victim = e; }
+    }
+
+    if (victim->basis != 0 && (victim->basis != basis || victim->h != p.h || victim->k != p.k || victim->l != p.l)) {
+        memo->evictions++;
+    }
+    *victim = (SFMemoEntry){ basis, p.h, p.k, p.l, memo->clock, intensity };
+
+    return;
+}
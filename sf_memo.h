@@ -0,0 +1,33 @@
+#ifndef SF_MEMO_H
+#define SF_MEMO_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "crystal.h"
+
+#define SF_MEMO_ENTRIES ((size_t)1 << 18)       // least slots of the table (32 bytes each)
+#define SF_MEMO_MAX_ENTRIES ((size_t)1 << 22)   // most slots; larger caches evict their oldest entries
+#define SF_MEMO_PROBES 4                        // slots searched from a key's home slot before the oldest is evicted
+
+
+
+void sf_memo_clear(SFMemo *memo);
+
+
+uint64_t sf_memo_fingerprint(const BasisAtoms *bas, const Lattice *lattice, double wavelength);
+
+
+bool sf_memo_begin(SFMemo *memo, Arena *arena, size_t n);
+
+
+bool sf_memo_seen(SFMemo *memo, uint64_t basis);
+
+
+bool sf_memo_lookup(SFMemo *memo, uint64_t basis, HKL p, double *intensity);
+
+
+void sf_memo_store(SFMemo *memo, uint64_t basis, HKL p, double intensity);
+
+
+#endif
@@ -0,0 +1,507 @@
+/****************************************************************************************
+ * spacegroup.c
+ *
+ * Space-group reflection conditions for all 230 groups
+ *  - Each group is stored as a Hall symbol (standard ITA settings: unique axis b, origin
+ *    choice 1, hexagonal axes for R except in the rhombohedral system)
+ *  - Loading a group parses the symbol, closes the generators into the full group (translations
+ *    in twelfths) and compiles the conditions: centring translations into a bit table over
+ *    (h,k,l) mod 12, glides and screws into one rule per rotation part that can extinguish anything
+ *
+ ****************************************************************************************/
+
+
+#include "spacegroup.h"
+
+#include <string.h>
+
+
+// Hermann-Mauguin symbol and Hall symbol of every group, by number - 1
+static const struct { const char *symbol; const char *hall; } SG_TABLE[SG_COUNT] = {
+    {"P1", "P 1"}, {"P-1", "-P 1"},
+    {"P2", "P 2y"}, {"P21", "P 2yb"}, {"C2", "C 2y"}, {"Pm", "P -2y"}, {"Pc", "P -2yc"},
+    {"Cm", "C -2y"}, {"Cc", "C -2yc"}, {"P2/m", "-P 2y"}, {"P21/m", "-P 2yb"}, {"C2/m", "-C 2y"},
+    {"P2/c", "-P 2yc"}, {"P21/c", "-P 2ybc"}, {"C2/c", "-C 2yc"},
+    {"P222", "P 2 2"}, {"P2221", "P 2c 2"}, {"P21212", "P 2 2ab"}, {"P212121", "P 2ac 2ab"},
+    {"C2221", "C 2c 2"}, {"C222", "C 2 2"}, {"F222", "F 2 2"}, {"I222", "I 2 2"},
+    {"I212121", "I 2b 2c"}, {"Pmm2", "P 2 -2"}, {"Pmc21", "P 2c -2"}, {"Pcc2", "P 2 -2c"},
+    {"Pma2", "P 2 -2a"}, {"Pca21", "P 2c -2ac"}, {"Pnc2", "P 2 -2bc"}, {"Pmn21", "P 2ac -2"},
+    {"Pba2", "P 2 -2ab"}, {"Pna21", "P 2c -2n"}, {"Pnn2", "P 2 -2n"}, {"Cmm2", "C 2 -2"},
+    {"Cmc21", "C 2c -2"}, {"Ccc2", "C 2 -2c"}, {"Amm2", "A 2 -2"}, {"Aem2", "A 2 -2c"},
+    {"Ama2", "A 2 -2a"}, {"Aea2", "A 2 -2ac"}, {"Fmm2", "F 2 -2"}, {"Fdd2", "F 2 -2d"},
+    {"Imm2", "I 2 -2"}, {"Iba2", "I 2 -2c"}, {"Ima2", "I 2 -2a"}, {"Pmmm", "-P 2 2"},
+    {"Pnnn", "P 2 2 -1n"}, {"Pccm", "-P 2 2c"}, {"Pban", "P 2 2 -1ab"}, {"Pmma", "-P 2a 2a"},
+    {"Pnna", "-P 2a 2bc"}, {"Pmna", "-P 2ac 2"}, {"Pcca", "-P 2a 2ac"}, {"Pbam", "-P 2 2ab"},
+    {"Pccn", "-P 2ab 2ac"}, {"Pbcm", "-P 2c 2b"}, {"Pnnm", "-P 2 2n"}, {"Pmmn", "P 2 2ab -1ab"},
+    {"Pbcn", "-P 2n 2ab"}, {"Pbca", "-P 2ac 2ab"}, {"Pnma", "-P 2ac 2n"}, {"Cmcm", "-C 2c 2"},
+    {"Cmce", "-C 2bc 2"}, {"Cmmm", "-C 2 2"}, {"Cccm", "-C 2 2c"}, {"Cmme", "-C 2b 2"},
+    {"Ccce", "C 2 2 -1bc"}, {"Fmmm", "-F 2 2"}, {"Fddd", "F 2 2 -1d"}, {"Immm", "-I 2 2"},
+    {"Ibam", "-I 2 2c"}, {"Ibca", "-I 2b 2c"}, {"Imma", "-I 2b 2"},
+    {"P4", "P 4"}, {"P41", "P 4w"}, {"P42", "P 4c"}, {"P43", "P 4cw"}, {"I4", "I 4"},
+    {"I41", "I 4bw"}, {"P-4", "P -4"}, {"I-4", "I -4"}, {"P4/m", "-P 4"}, {"P42/m", "-P 4c"},
+    {"P4/n", "P 4ab -1ab"}, {"P42/n", "P 4n -1n"}, {"I4/m", "-I 4"}, {"I41/a", "I 4bw -1bw"},
+    {"P422", "P 4 2"}, {"P4212", "P 4ab 2ab"}, {"P4122", "P 4w 2c"}, {"P41212", "P 4abw 2nw"},
+    {"P4222", "P 4c 2"}, {"P42212", "P 4n 2n"}, {"P4322", "P 4cw 2c"}, {"P43212", "P 4nw 2abw"},
+    {"I422", "I 4 2"}, {"I4122", "I 4bw 2bw"}, {"P4mm", "P 4 -2"}, {"P4bm", "P 4 -2ab"},
+    {"P42cm", "P 4c -2c"}, {"P42nm", "P 4n -2n"}, {"P4cc", "P 4 -2c"}, {"P4nc", "P 4 -2n"},
+    {"P42mc", "P 4c -2"}, {"P42bc", "P 4c -2ab"}, {"I4mm", "I 4 -2"}, {"I4cm", "I 4 -2c"},
+    {"I41md", "I 4bw -2"}, {"I41cd", "I 4bw -2c"}, {"P-42m", "P -4 2"}, {"P-42c", "P -4 2c"},
+    {"P-421m", "P -4 2ab"}, {"P-421c", "P -4 2n"}, {"P-4m2", "P -4 -2"}, {"P-4c2", "P -4 -2c"},
+    {"P-4b2", "P -4 -2ab"}, {"P-4n2", "P -4 -2n"}, {"I-4m2", "I -4 -2"}, {"I-4c2", "I -4 -2c"},
+    {"I-42m", "I -4 2"}, {"I-42d", "I -4 2bw"}, {"P4/mmm", "-P 4 2"}, {"P4/mcc", "-P 4 2c"},
+    {"P4/nbm", "P 4 2 -1ab"}, {"P4/nnc", "P 4 2 -1n"}, {"P4/mbm", "-P 4 2ab"}, {"P4/mnc", "-P 4 2n"},
+    {"P4/nmm", "P 4ab 2ab -1ab"}, {"P4/ncc", "P 4ab 2n -1ab"}, {"P42/mmc", "-P 4c 2"},
+    {"P42/mcm", "-P 4c 2c"}, {"P42/nbc", "P 4n 2c -1n"}, {"P42/nnm", "P 4n 2 -1n"},
+    {"P42/mbc", "-P 4c 2ab"}, {"P42/mnm", "-P 4n 2n"}, {"P42/nmc", "P 4n 2n -1n"},
+    {"P42/ncm", "P 4n 2ab -1n"}, {"I4/mmm", "-I 4 2"}, {"I4/mcm", "-I 4 2c"},
+    {"I41/amd", "I 4bw 2bw -1bw"}, {"I41/acd", "I 4bw 2aw -1bw"},
+    {"P3", "P 3"}, {"P31", "P 31"}, {"P32", "P 32"}, {"R3", "R 3"}, {"P-3", "-P 3"}, {"R-3", "-R 3"},
+    {"P312", "P 3 2"}, {"P321", "P 3 2\""}, {"P3112", "P 31 2c (0 0 1)"}, {"P3121", "P 31 2\""},
+    {"P3212", "P 32 2c (0 0 -1)"}, {"P3221", "P 32 2\""}, {"R32", "R 3 2\""}, {"P3m1", "P 3 -2\""},
+    {"P31m", "P 3 -2"}, {"P3c1", "P 3 -2\"c"}, {"P31c", "P 3 -2c"}, {"R3m", "R 3 -2\""},
+    {"R3c", "R 3 -2\"c"}, {"P-31m", "-P 3 2"}, {"P-31c", "-P 3 2c"}, {"P-3m1", "-P 3 2\""},
+    {"P-3c1", "-P 3 2\"c"}, {"R-3m", "-R 3 2\""}, {"R-3c", "-R 3 2\"c"},
+    {"P6", "P 6"}, {"P61", "P 61"}, {"P65", "P 65"}, {"P62", "P 62"}, {"P64", "P 64"}, {"P63", "P 6c"},
+    {"P-6", "P -6"}, {"P6/m", "-P 6"}, {"P63/m", "-P 6c"}, {"P622", "P 6 2"},
+    {"P6122", "P 61 2 (0 0 -1)"}, {"P6522", "P 65 2 (0 0 1)"}, {"P6222", "P 62 2c (0 0 1)"},
+    {"P6422", "P 64 2c (0 0 -1)"}, {"P6322", "P 6c 2c"}, {"P6mm", "P 6 -2"}, {"P6cc", "P 6 -2c"},
+    {"P63cm", "P 6c -2"}, {"P63mc", "P 6c -2c"}, {"P-6m2", "P -6 2"}, {"P-6c2", "P -6c 2"},
+    {"P-62m", "P -6 -2"}, {"P-62c", "P -6c -2c"}, {"P6/mmm", "-P 6 2"}, {"P6/mcc", "-P 6 2c"},
+    {"P63/mcm", "-P 6c 2"}, {"P63/mmc", "-P 6c 2c"},
+    {"P23", "P 2 2 3"}, {"F23", "F 2 2 3"}, {"I23", "I 2 2 3"}, {"P213", "P 2ac 2ab 3"},
+    {"I213", "I 2b 2c 3"}, {"Pm-3", "-P 2 2 3"}, {"Pn-3", "P 2 2 3 -1n"}, {"Fm-3", "-F 2 2 3"},
+    {"Fd-3", "F 2 2 3 -1d"}, {"Im-3", "-I 2 2 3"}, {"Pa-3", "-P 2ac 2ab 3"}, {"Ia-3", "-I 2b 2c 3"},
+    {"P432", "P 4 2 3"}, {"P4232", "P 4n 2 3"}, {"F432", "F 4 2 3"}, {"F4132", "F 4d 2 3"},
+    {"I432", "I 4 2 3"}, {"P4332", "P 4acd 2ab 3"}, {"P4132", "P 4bd 2ab 3"}, {"I4132", "I 4bd 2c 3"},
+    {"P-43m", "P -4 2 3"}, {"F-43m", "F -4 2 3"}, {"I-43m", "I -4 2 3"}, {"P-43n", "P -4n 2 3"},
+    {"F-43c", "F -4c 2 3"}, {"I-43d", "I -4bd 2c 3"}, {"Pm-3m", "-P 4 2 3"}, {"Pn-3n", "P 4 2 3 -1n"},
+    {"Pm-3n", "-P 4n 2 3"}, {"Pn-3m", "P 4n 2 3 -1n"}, {"Fm-3m", "-F 4 2 3"}, {"Fm-3c", "-F 4c 2 3"},
+    {"Fd-3m", "F 4d 2 3 -1d"}, {"Fd-3c", "F 4d 2 3 -1cd"}, {"Im-3m", "-I 4 2 3"}, {"Ia-3d", "-I 4bd 2c 3"},
+};
+
+
+// The R groups on rhombohedral axes (a = b = c, alpha = beta = gamma)
+static const struct { int number; const char *hall; } SG_RHOMBOHEDRAL[] = {
+    {146, "P 3*"}, {148, "-P 3*"}, {155, "P 3* 2"}, {160, "P 3* -2"},
+    {161, "P 3* -2n"}, {166, "-P 3* 2"}, {167, "-P 3* 2n"},
+};
+
+
+// STRUCTS ------------------------ //
+
+// Seitz operation x' = R x + t, t in twelfths (mod 12)
+typedef struct {
+    int R[3][3];
+    int t[3];
+} SGOp;
+
+
+typedef struct {
+    size_t n;
+    SGOp ops[SG_MAX_OPS];
+} SGGroup;
+
+
+// Proper rotations about x, y, z (index 0, 1, 2) for N = 2, 3, 4, 6
+static const int SG_ROT[4][3][3][3] = {
+    {   // 2
+        {{1, 0, 0}, {0, -1, 0}, {0, 0, -1}},
+        {{-1, 0, 0}, {0, 1, 0}, {0, 0, -1}},
+        {{-1, 0, 0}, {0, -1, 0}, {0, 0, 1}},
+    },
+    {   // 3
+        {{1, 0, 0}, {0, 0, -1}, {0, 1, -1}},
+        {{-1, 0, 1}, {0, 1, 0}, {-1, 0, 0}},
+        {{0, -1, 0}, {1, -1, 0}, {0, 0, 1}},
+    },
+    {   // 4
+        {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}},
+        {{0, 0, 1}, {0, 1, 0}, {-1, 0, 0}},
+        {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}},
+    },
+    {   // 6
+        {{1, 0, 0}, {0, 1, -1}, {0, 1, 0}},
+        {{0, 0, 1}, {0, 1, 0}, {-1, 0, 1}},
+        {{1, -1, 0}, {1, 0, 0}, {0, 0, 1}},
+    },
+};
+
+
+// Face-diagonal 2-folds (' and ") relative to the preceding axis x, y, z
+static const int SG_ROT_PRIME[2][3][3][3] = {
+    {   // '
+        {{-1, 0, 0}, {0, 0, -1}, {0, -1, 0}},
+        {{0, 0, -1}, {0, -1, 0}, {-1, 0, 0}},
+        {{0, -1, 0}, {-1, 0, 0}, {0, 0, -1}},
+    },
+    {   // "
+        {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+        {{0, 0, 1}, {0, -1, 0}, {1, 0, 0}},
+        {{0, 1, 0}, {1, 0, 0}, {0, 0, -1}},
+    },
+};
+
+
+// Body-diagonal 3-fold (*)
+static const int SG_ROT_BODY[3][3] = {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}};
+
+
+
+const char *sg_symbol(int number) {
+    if (number < 1 || number > SG_COUNT) { return "none"; }
+    return SG_TABLE[number - 1].symbol;
+}
+
+
+// Hall symbol of a group in the setting used for the given axes
+static const char *sg_hall(int number, bool rhombohedral_axes) {
+    if (number < 1 || number > SG_COUNT) { return NULL; }
+
+    if (rhombohedral_axes) {
+        for (size_t i = 0; i < sizeof(SG_RHOMBOHEDRAL) / sizeof(SG_RHOMBOHEDRAL[0]); i++) {
+            if (SG_RHOMBOHEDRAL[i].number == number) { return SG_RHOMBOHEDRAL[i].hall; }
+        }
+    }
+
+    return SG_TABLE[number - 1].hall;
+}
+
+
+// Lattice letter (P, A, C, I, F, R) of a group in its standard setting, 0 if there is no such group
+char sg_centring(int number) {
+    if (number < 1 || number > SG_COUNT) { return 0; }
+    const char *hall = SG_TABLE[number - 1].hall;
+    return hall[0] == '-' ? hall[1] : hall[0];
+}
+
+
+static int sg_mod(int x) {
+    x %= SG_MOD;
+    return x < 0 ? x + SG_MOD : x;
+}
+
+
+static SGOp sg_compose(const SGOp *a, const SGOp *b) {
+    SGOp c;
+    for (int i = 0; i < 3; i++) {
+        c.t[i] = a->t[i];
+        for (int j = 0; j < 3; j++) {
+            c.R[i][j] = 0;
+            for (int k = 0; k < 3; k++) { c.R[i][j] += a->R[i][k] * b->R[k][j]; }
+            c.t[i] += a->R[i][j] * b->t[j];
+        }
+        c.t[i] = sg_mod(c.t[i]);
+    }
+    return c;
+}
+
+
+static bool sg_contains(const SGGroup *g, const SGOp *op) {
+    for (size_t i = 0; i < g->n; i++) {
+        if (memcmp(&g->ops[i], op, sizeof(*op)) == 0) { return true; }
+    }
+    return false;
+}
+
+
+static bool sg_add(SGGroup *g, SGOp op) {
+    if (sg_contains(g, &op)) { return true; }
+    if (g->n == SG_MAX_OPS) { return false; }
+    g->ops[g->n++] = op;
+    return true;
+}
+
+
+// Close the generators in g under composition (products of every pair until nothing new appears)
+static bool sg_close(SGGroup *g) {
+    for (size_t i = 0; i < g->n; i++) {
+        for (size_t j = 0; j <= i; j++) {
+            if (!sg_add(g, sg_compose(&g->ops[i], &g->ops[j]))) { return false; }
+            if (!sg_add(g, sg_compose(&g->ops[j], &g->ops[i]))) { return false; }
+        }
+    }
+    return true;
+}
+
+
+// Translation symbol letter -> twelfths
+static bool sg_translation(char c, int t[3]) {
+    switch (c) {
+        case 'a': t[0] += 6; return true;
+        case 'b': t[1] += 6; return true;
+        case 'c': t[2] += 6; return true;
+        case 'n': t[0] += 6; t[1] += 6; t[2] += 6; return true;
+        case 'u': t[0] += 3; return true;
+        case 'v': t[1] += 3; return true;
+        case 'w': t[2] += 3; return true;
+        case 'd': t[0] += 3; t[1] += 3; t[2] += 3; return true;
+        default:  return false;
+    }
+}
+
+
+// Parse a Hall symbol into its generators: centring translations, inversion, one operation per matrix
+//  symbol, with the default axes of Hall (1981) and the optional origin shift "(x y z)" in twelfths
+static bool sg_parse(const char *hall, SGGroup *g) {
+    g->n = 0;
+    SGOp identity = { .R = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}} };
+    if (!sg_add(g, identity)) { return false; }
+
+    const char *s = hall;
+    bool centro = *s == '-';
+    if (centro) { s++; }
+
+    static const int CENTRING[][3] = {
+        ['A' - 'A'] = {0, 6, 6}, ['B' - 'A'] = {6, 0, 6}, ['C' - 'A'] = {6, 6, 0}, ['I' - 'A'] = {6, 6, 6},
+    };
+    switch (*s) {
+        case 'P': break;
+        case 'A': case 'B': case 'C': case 'I': {
+            SGOp op = identity;
+            memcpy(op.t, CENTRING[*s - 'A'], sizeof(op.t));
+            if (!sg_add(g, op)) { return false; }
+            break;
+        }
+        case 'R': {
+            SGOp op = identity;
+            op.t[0] = 8; op.t[1] = 4; op.t[2] = 4;
+            if (!sg_add(g, op)) { return false; }
+            break;
+        }
+        case 'F':
+            for (int i = 0; i < 3; i++) {
+                SGOp op = identity;
+                op.t[0] = op.t[1] = op.t[2] = 6;
+                op.t[i] = 0;
+                if (!sg_add(g, op)) { return false; }
+            }
+            break;
+        default: return false;
+    }
+    s++;
+
+    if (centro) {
+        SGOp op = { .R = {{-1, 0, 0}, {0, -1, 0}, {0, 0, -1}} };
+        if (!sg_add(g, op)) { return false; }
+    }
+
+    // Matrix symbols, each followed by either another one, the origin shift or the end
+    SGOp gens[4];
+    size_t n_gens = 0;
+    int prev_n = 0, prev_axis = 2;
+    int shift[3] = {0, 0, 0};
+
+    while (*s) {
+        while (*s == ' ') { s++; }
+        if (!*s) { break; }
+
+        if (*s == '(') {
+            s++;
+            for (int i = 0; i < 3; i++) {
+                char *end;
+                shift[i] = (int)strtol(s, &end, 10);
+                if (end == s) { return false; }
+                s = end;
+            }
+            while (*s == ' ') { s++; }
+            if (*s != ')') { return false; }
+            s++;
+            continue;
+        }
+
+        if (n_gens == sizeof(gens) / sizeof(gens[0])) { return false; }
+
+        bool improper = *s == '-';
+        if (improper) { s++; }
+        if (*s < '1' || *s > '6') { return false; }
+        int order = *s++ - '0';
+
+        int screw = 0;
+        if (*s >= '1' && *s <= '5') { screw = *s++ - '0'; }
+
+        // Axis: explicit, or the Hall defaults from position and the preceding rotation
+        char axis = 0;
+        if (*s == 'x' || *s == 'y' || *s == 'z' || *s == '\'' || *s == '"' || *s == '*') { axis = *s++; }
+        if (!axis) {
+            if (n_gens == 0) { axis = 'z'; }
+            else if (n_gens == 1 && order == 2) { axis = (prev_n == 2 || prev_n == 4) ? 'x' : '\''; }
+            else if (n_gens == 2 && order == 3) { axis = '*'; }
+            else if (order == 1) { axis = 'z'; }
+            else { return false; }
+        }
+
+        SGOp op = {0};
+        int principal = -1;
+        if (order == 1) {
+            op = identity;
+        }
+        else if (axis == '*') {
+            if (order != 3) { return false; }
+            memcpy(op.R, SG_ROT_BODY, sizeof(op.R));
+        }
+        else if (axis == '\'' || axis == '"') {
+            if (order != 2) { return false; }
+            memcpy(op.R, SG_ROT_PRIME[axis == '"'][prev_axis], sizeof(op.R));
+        }
+        else {
+            static const int ORDER_INDEX[7] = { -1, -1, 0, 1, 2, -1, 3 };
+            if (ORDER_INDEX[order] < 0) { return false; }
+            principal = axis - 'x';
+            memcpy(op.R, SG_ROT[ORDER_INDEX[order]][principal], sizeof(op.R));
+        }
+
+        if (screw) {
+            if (principal < 0 || screw >= order) { return false; }
+            op.t[principal] += SG_MOD * screw / order;
+        }
+        while (sg_translation(*s, op.t)) { s++; }
+        if (*s && *s != ' ') { return false; }
+
+        if (improper) {
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 3; j++) { op.R[i][j] = -op.R[i][j]; }
+            }
+        }
+
+        gens[n_gens++] = op;
+        prev_n = order;
+        if (principal >= 0) { prev_axis = principal; }
+    }
+
+    for (size_t i = 0; i < n_gens; i++) {
+        for (int j = 0; j < 3; j++) { gens[i].t[j] = sg_mod(gens[i].t[j]); }
+        if (!sg_add(g, gens[i])) { return false; }
+    }
+
+    if (!sg_close(g)) { return false; }
+
+    // Origin shift v: (R, t) -> (R, t + (I - R) v)
+    if (shift[0] || shift[1] || shift[2]) {
+        for (size_t i = 0; i < g->n; i++) {
+            SGOp *op = &g->ops[i];
+            for (int j = 0; j < 3; j++) {
+                int Rv = op->R[j][0] * shift[0] + op->R[j][1] * shift[1] + op->R[j][2] * shift[2];
+                op->t[j] = sg_mod(op->t[j] + shift[j] - Rv);
+            }
+        }
+    }
+
+    return true;
+}
+
+
+static bool sg_is_identity(const int R[3][3]) {
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            if (R[i][j] != (i == j)) { return false; }
+        }
+    }
+    return true;
+}
+
+
+// Does any reflection fixed by the rule (and not already removed by centring) have h.t non-integral?
+//  The fixed reflections form a lattice generated by vectors with entries in [-2, 2], so a small box decides
+static bool sg_rule_active(const SpaceGroup *sg, const SGRule *rule) {
+    const int range = 4;
+    HKL p;
+    for (p.h = -range; p.h <= range; p.h++) {
+        for (p.k = -range; p.k <= range; p.k++) {
+            for (p.l = -range; p.l <= range; p.l++) {
+                int hm[3] = { sg_mod(p.h), sg_mod(p.k), sg_mod(p.l) };
+                if (sg_absent(sg, p)) { continue; }
+                if (sg_rule_absent(rule, p, hm)) { return true; }
+            }
+        }
+    }
+    return false;
+}
+
+
+// Compile the reflection conditions of a group (1..230; 0 clears them)
+//  rhombohedral_axes picks the primitive rhombohedral setting for the seven R groups
+bool sg_load(SpaceGroup *sg, int number, bool rhombohedral_axes) {
+    if (!sg) { return false; }
+
+    memset(sg, 0, sizeof(*sg));
+    sg->symbol = sg_symbol(number);
+    if (number == 0) { return true; }
+
+    const char *hall = sg_hall(number, rhombohedral_axes);
+    if (!hall) { return false; }
+
+    SGGroup g;
+    if (!sg_parse(hall, &g)) { return false; }
+
+    sg->number = number;
+    sg->order = (int)g.n;
+
+    // Centring: pure translations, absent when h.t is not a whole number for any of them
+    for (size_t i = 0; i < g.n; i++) {
+        const SGOp *op = &g.ops[i];
+        if (!sg_is_identity(op->R) || (op->t[0] == 0 && op->t[1] == 0 && op->t[2] == 0)) { continue; }
+
+        sg->centred = true;
+        for (int h = 0; h < SG_MOD; h++) {
+            for (int k = 0; k < SG_MOD; k++) {
+                for (int l = 0; l < SG_MOD; l++) {
+                    if ((h * op->t[0] + k * op->t[1] + l * op->t[2]) % SG_MOD == 0) { continue; }
+                    int cell = (h * SG_MOD + k) * SG_MOD + l;
+                    sg->integral[cell >> 3] |= (uint8_t)(1u << (cell & 7));
+                }
+            }
+        }
+    }
+
+    // Glides and screws: operations sharing a rotation part differ by a centring translation,
+    //  which the integral table already accounts for, so one rule per rotation part is enough
+    for (size_t i = 0; i < g.n; i++) {
+        const SGOp *op = &g.ops[i];
+        if (sg_is_identity(op->R)) { continue; }
+
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; j++) {
+            seen = memcmp(g.ops[j].R, op->R, sizeof(op->R)) == 0;
+        }
+        if (seen) { continue; }
+
+        SGRule rule;
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) { rule.M[r][c] = (int8_t)(op->R[r][c] - (r == c)); }
+            rule.t[r] = (int8_t)op->t[r];
+        }
+        if (!sg_rule_active(sg, &rule)) { continue; }
+
+        if (sg->n_rules == SG_MAX_RULES) { return false; }
+        sg->rules[sg->n_rules++] = rule;
+    }
+
+    return true;
+}
+
+
+// Distinct rotation parts of a group (its point group) as integer matrices on fractional coordinates;
+//  returns their count, 0 if the group is unknown
+size_t sg_point_ops(int number, bool rhombohedral_axes, int R[SG_MAX_POINT_OPS][3][3]) {
+    if (!R) { return 0; }
+
+    const char *hall = sg_hall(number, rhombohedral_axes);
+    if (!hall) { return 0; }
+
+    SGGroup g;
+    if (!sg_parse(hall, &g)) { return 0; }
+
+    size_t n = 0;
+    for (size_t i = 0; i < g.n; i++) {
+        bool seen = false;
+        for (size_t j = 0; j < n && !seen; j++) {
+            seen = memcmp(R[j], g.ops[i].R, sizeof(g.ops[i].R)) == 0;
+        }
+        if (seen) { continue; }
+
+        if (n == SG_MAX_POINT_OPS) { return 0; }
+        memcpy(R[n++], g.ops[i].R, sizeof(g.ops[i].R));
+    }
+
+    return n;
+}
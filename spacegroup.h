@@ -0,0 +1,84 @@
+#ifndef SPACEGROUP_H
+#define SPACEGROUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "math_helper.h"
+
+#define SG_COUNT 230
+#define SG_MOD 12           // translations are kept in twelfths of a cell edge
+#define SG_MAX_OPS 192      // largest group order modulo lattice translations (Fm-3m)
+#define SG_MAX_RULES 48     // one rule per rotation part at most
+#define SG_MAX_POINT_OPS 48 // rotation parts of the largest point group (m-3m)
+
+
+// STRUCTS ------------------------ //
+
+// Zonal/serial reflection condition from one operation (R, t): reflections with h R = h
+//  pick up the phase exp(2PI i h.t) under the operation, so they are absent unless h.t is integral
+typedef struct {
+    int8_t M[3][3];     // R - I; the rule applies when h . M[][j] = 0 for every column j
+    int8_t t[3];        // translation in twelfths
+} SGRule;
+
+
+// Space group compiled to reflection-condition tables
+//  Centring (integral) conditions depend only on (h,k,l) mod 12 and are a bit table;
+//  glide planes and screw axes are a short list of rules
+typedef struct {
+    int number;         // 1..230, 0 = no conditions beyond the basis
+    const char *symbol; // Hermann-Mauguin short symbol
+    int order;          // operations modulo lattice translations, centring included
+    bool centred;
+    uint8_t integral[SG_MOD * SG_MOD * SG_MOD / 8];
+    size_t n_rules;
+    SGRule rules[SG_MAX_RULES];
+} SpaceGroup;
+
+
+// Does a glide/screw rule extinguish p? (hm = (h,k,l) reduced mod 12)
+static inline bool sg_rule_absent(const SGRule *r, HKL p, const int hm[3]) {
+    if (p.h * r->M[0][0] + p.k * r->M[1][0] + p.l * r->M[2][0] != 0) { return false; }
+    if (p.h * r->M[0][1] + p.k * r->M[1][1] + p.l * r->M[2][1] != 0) { return false; }
+    if (p.h * r->M[0][2] + p.k * r->M[1][2] + p.l * r->M[2][2] != 0) { return false; }
+    return (hm[0] * r->t[0] + hm[1] * r->t[1] + hm[2] * r->t[2]) % SG_MOD != 0;
+}
+
+
+// Is reflection p systematically absent in the space group?
+static inline bool sg_absent(const SpaceGroup *sg, HKL p) {
+    if (!sg || sg->number == 0) { return false; }
+
+    int hm[3] = { p.h % SG_MOD, p.k % SG_MOD, p.l % SG_MOD };
+    for (int i = 0; i < 3; i++) {
+        if (hm[i] < 0) { hm[i] += SG_MOD; }
+    }
+
+    if (sg->centred) {
+        int cell = (hm[0] * SG_MOD + hm[1]) * SG_MOD + hm[2];
+        if (sg->integral[cell >> 3] & (1u << (cell & 7))) { return true; }
+    }
+
+    for (size_t i = 0; i < sg->n_rules; i++) {
+        if (sg_rule_absent(&sg->rules[i], p, hm)) { return true; }
+    }
+
+    return false;
+}
+
+
+
+const char *sg_symbol(int number);
+
+
+char sg_centring(int number);
+
+
+bool sg_load(SpaceGroup *sg, int number, bool rhombohedral_axes);
+
+
+size_t sg_point_ops(int number, bool rhombohedral_axes, int R[SG_MAX_POINT_OPS][3][3]);
+
+
+#endif